@@ -0,0 +1,312 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <getopt.h>
+
+#include "common.h"
+#include "convert.h"
+#include "format.h"
+#include "worker.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define DEFAULT_RUNS	51
+
+/* bytes moved per pixel : YUYV in, XRGB8888 out */
+#define BYTES_PER_PIXEL	(2 + 4)
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct frame_size {
+	uint32_t	width, height;
+};
+
+struct bench {
+	unsigned int		runs;
+	struct worker_ctx  *workers;	/* NULL : single thread */
+	uint64_t		   *samples;	/* 'runs' durations [ns] */
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static bool bench_size(struct bench *bench, uint32_t width, uint32_t height);
+static uint64_t time_run(struct bench *bench, enum convert_impl impl, void *dst, void *src,
+	uint32_t width, uint32_t height);
+static void fill_frame(uint8_t *data, size_t size);
+static int compare_u64(const void *a, const void *b);
+static uint64_t get_time_ns(void);
+static void usage(FILE *fp, int argc, char *argv[]);
+
+
+/*======================================
+	Variable
+======================================*/
+
+static const struct frame_size sizes[] = {
+	{  640,  480 },
+	{ 1280,  720 },
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+};
+
+
+/*======================================
+	Public function
+======================================*/
+
+/*
+ * Times every available YUYV to XRGB8888 implementation on synthetic frames
+ * and checks it against convert_yuyv_to_bgrx8888(). One CSV line per
+ * (size, implementation) on stdout, the exit status is non-zero if any
+ * output differs.
+ */
+int
+main(int argc, char *argv[])
+{
+	static const char short_options[] = "r:t:h";
+	static const struct option long_options[] = {
+		{ "runs",		required_argument,	NULL, 'r' },
+		{ "threads",	required_argument,	NULL, 't' },
+		{ "help",		no_argument,		NULL, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	struct bench bench = { 0 };
+	unsigned int threads = 1;
+	unsigned int i;
+	bool exact = true;
+
+	bench.runs = DEFAULT_RUNS;
+
+	do {
+		int idx;
+		int c;
+
+		c = getopt_long(argc, argv,
+				short_options, long_options, &idx);
+
+		if (-1 == c)
+			break;
+
+		switch (c) {
+		case 'r':
+			bench.runs = strtoul(optarg, NULL, 0);
+			break;
+
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'h':
+			usage(stdout, argc, argv);
+			exit(EXIT_SUCCESS);
+
+		default:
+			usage(stderr, argc, argv);
+			exit(EXIT_FAILURE);
+		}
+	} while (1);
+
+	if (!bench.runs) {
+		usage(stderr, argc, argv);
+		exit(EXIT_FAILURE);
+	}
+
+	convert_init();
+
+	if (threads > 1) {
+		bench.workers = worker_init(threads);
+		if (!bench.workers)
+			exit(EXIT_FAILURE);
+	}
+
+	bench.samples = calloc(bench.runs, sizeof(uint64_t));
+	if (!bench.samples) {
+		LOG_ERROR("Out of Memory");
+		worker_terminate(bench.workers);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("impl,width,height,threads,runs,median_ns,ns_per_pixel,gb_per_s,exact\n");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		if (!bench_size(&bench, sizes[i].width, sizes[i].height))
+			exact = false;
+
+	free(bench.samples);
+	worker_terminate(bench.workers);
+
+	return exact ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+static bool
+bench_size(struct bench *bench, uint32_t width, uint32_t height)
+{
+	size_t src_size = format_get_frame_size(FORMAT_YUYV, width, height);
+	size_t dst_size = format_get_frame_size(FORMAT_XRGB8888, width, height);
+	uint8_t *src, *ref, *dst;
+	bool all_exact = true;
+	int impl;
+
+	src = malloc(src_size);
+	ref = malloc(dst_size);
+	dst = malloc(dst_size);
+	if (!src || !ref || !dst) {
+		LOG_ERROR("Out of Memory");
+		free(src);
+		free(ref);
+		free(dst);
+		return false;
+	}
+
+	fill_frame(src, src_size);
+	convert_yuyv_to_bgrx8888(ref, src, width, height);
+
+	for (impl = 0; impl < CONVERT_IMPL_NR; impl++) {
+		uint64_t median;
+		double pixels = (double)width * height;
+		bool exact;
+
+		if (!convert_impl_is_supported(impl))
+			continue;
+
+		/* poison, so that a kernel skipping pixels cannot pass */
+		memset(dst, 0x5a, dst_size);
+
+		median	= time_run(bench, impl, dst, src, width, height);
+		exact	= memcmp(dst, ref, dst_size) == 0;
+		if (!exact)
+			all_exact = false;
+
+		printf("%s,%u,%u,%u,%u,%llu,%.4f,%.3f,%d\n",
+			convert_impl_get_name(impl), width, height,
+			bench->workers ? worker_get_threads(bench->workers) : 1, bench->runs,
+			(unsigned long long)median, median / pixels,
+			pixels * BYTES_PER_PIXEL / median, exact);
+		fflush(stdout);
+	}
+
+	free(src);
+	free(ref);
+	free(dst);
+
+	return all_exact;
+}
+
+/* median of 'runs' conversions after one warm-up, the output of the last one stays in 'dst' */
+static uint64_t
+time_run(struct bench *bench, enum convert_impl impl, void *dst, void *src,
+	uint32_t width, uint32_t height)
+{
+	unsigned int i;
+
+	convert_run_impl(impl, CONVERT_MATRIX_LEGACY, bench->workers, FORMAT_YUYV, FORMAT_XRGB8888,
+			dst, src, width, height);
+
+	for (i = 0; i < bench->runs; i++) {
+		uint64_t start = get_time_ns();
+
+		convert_run_impl(impl, CONVERT_MATRIX_LEGACY, bench->workers, FORMAT_YUYV, FORMAT_XRGB8888,
+				dst, src, width, height);
+
+		bench->samples[i] = get_time_ns() - start;
+	}
+
+	qsort(bench->samples, bench->runs, sizeof(uint64_t), compare_u64);
+
+	return bench->samples[bench->runs / 2];
+}
+
+/* xorshift noise : every Y/U/V value and clamp path shows up, and it is the same every run */
+static void
+fill_frame(uint8_t *data, size_t size)
+{
+	uint32_t state = 0x9e3779b9;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		data[i] = state >> 24;
+	}
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t
+get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+usage(FILE *fp, int argc, char *argv[])
+{
+	fprintf(fp,
+		 "Usage: %s [options]\n\n"
+		 "Times YUYV to XRGB8888 conversion, CSV on stdout\n"
+		 "Options:\n"
+		 "-r | --runs N        Runs per measurement, the median is reported [%d]\n"
+		 "-t | --threads N     Convert in N row bands on a worker pool [1]\n"
+		 "-h | --help          Print this message\n"
+		 "",
+		 argv[0], DEFAULT_RUNS);
+}
@@ -31,98 +31,68 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <assert.h>
 
-#include <fcntl.h>
-#include <getopt.h>
-#include <sys/stat.h>
 #include <errno.h>
+#include <poll.h>
 #include <unistd.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-
-#include <linux/videodev2.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #include "common.h"
 #include "camera.h"
+#include "camera_backend.h"
+#include "convert.h"
+#include "format.h"
+#include "util.h"
 
 /*======================================
 	Constant
 ======================================*/
 
-#define DEVICE_NAME		"/dev/video0"
-#define PIXEL_FORMAT	V4L2_PIX_FMT_YUYV
-#define PIXEL_DEPTH		2					/* 2 Bytes per pixel */
-
-
-/*======================================
-	Structure
-======================================*/
-
-struct buffer {
-	void   *start;
-	size_t	length;
-};
-
-struct camera_ctx {
-	char		   *dev_name;
-	int				fd;
-	struct buffer  *buffers;
-	unsigned int	buffers_nr;
-
-	uint32_t		width, height;
-};
+#define WAIT_TIMEOUT	2000	/* [ms] */
+#define DEFAULT_FPS		30		/* file and pattern */
 
 
 /*======================================
 	Prototype
 ======================================*/
 
-static bool open_device(struct camera_ctx *ctx);
-static void close_device(struct camera_ctx *ctx);
-
-static bool init_device(struct camera_ctx *ctx);
-static void terminate_device(struct camera_ctx *ctx);
-
-static bool init_mmap(struct camera_ctx *ctx);
-
-static int read_frame(struct camera_ctx *ctx, void *dest, unsigned int dest_size);
-
-static bool get_frame_size(struct camera_ctx *ctx);
-
-static int xioctl(int fd, int request, void *arg);
+static const struct camera_backend *find_backend(const char *name, const char **arg);
+static bool wait_frame(struct camera_ctx *ctx);
 
 
 /*======================================
 	Public function
 ======================================*/
 
+/*
+ * 'formats' lists the pixel formats the caller can handle, most preferred
+ * first; the first one the source offers is negotiated.
+ */
 struct camera_ctx *
-camera_init(char *dev_name)
+camera_init(const struct camera_config *config, const uint32_t *formats, unsigned int formats_nr)
 {
+	struct camera_config conf;
 	struct camera_ctx *ctx;
 
-	ctx = (struct camera_ctx *)malloc(sizeof(struct camera_ctx));
+	if (!config || !config->name || !formats)
+		return NULL;
+
+	ctx = (struct camera_ctx *)calloc(1, sizeof(struct camera_ctx));
 	if (!ctx) {
 		LOG_ERROR("Out of Memory");
 		return NULL;
 	}
 
-	ctx->dev_name = dev_name;
-
-	if (!open_device(ctx)) {
-		free(ctx);
-		return NULL;
-	}
+	/* the backend sees its own part of the name */
+	conf = *config;
+	ctx->backend = find_backend(config->name, &conf.name);
 
-	if (!get_frame_size(ctx)) {
-		close_device(ctx);
-		free(ctx);
-		return NULL;
-	}
+	/* a device runs at the rate of the mode it negotiates */
+	if (conf.fps < 0 && ctx->backend != &camera_v4l2_backend)
+		conf.fps = DEFAULT_FPS;
 
-	if (!init_device(ctx)) {
-		close_device(ctx);
+	if (!ctx->backend->open(ctx, &conf, formats, formats_nr)) {
 		free(ctx);
 		return NULL;
 	}
@@ -136,103 +106,98 @@ camera_terminate(struct camera_ctx *ctx)
 	if (!ctx)
 		return;
 
-	terminate_device(ctx);
-	close_device(ctx);
+	ctx->backend->close(ctx);
 	free(ctx);
 }
 
 bool
 camera_start_capturing(struct camera_ctx *ctx)
 {
-	unsigned int i;
-	struct v4l2_buffer buf;
-	enum v4l2_buf_type type;
-
 	if (!ctx)
 		return false;
 
-	for (i = 0; i < ctx->buffers_nr; i++) {
-		memset(&buf, 0, sizeof(buf));
-		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory = V4L2_MEMORY_MMAP;
-		buf.index = i;
-
-		if (xioctl(ctx->fd, VIDIOC_QBUF, &buf) < 0) {
-			LOG_PERROR("VIDIOC_QBUF");
-			return false;
-		}
-	}
+	return ctx->backend->start(ctx);
+}
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	if (xioctl(ctx->fd, VIDIOC_STREAMON, &type) < 0) {
-		LOG_PERROR("VIDIOC_STREAMON");
+bool
+camera_stop_capturing(struct camera_ctx *ctx)
+{
+	if (!ctx)
 		return false;
-	}
 
-	/* empty reading */
-	for (i = 0; i < 5; i++)
-		camera_read_frame(ctx, NULL, 0);
-
-	return true;
+	return ctx->backend->stop(ctx);
 }
 
 bool
-camera_stop_capturing(struct camera_ctx *ctx)
+camera_acquire_frame(struct camera_ctx *ctx, struct camera_frame *frame)
 {
-	enum v4l2_buf_type type;
+	int status;
 
-	if (!ctx)
+	if (!ctx || !frame)
 		return false;
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	if (xioctl(ctx->fd, VIDIOC_STREAMOFF, &type) < 0) {
-		LOG_PERROR("VIDIOC_STREAMOFF");
-		return false;
+	/* called once the fd polled ready the frame is there, no need to wait */
+	while ((status = ctx->backend->acquire(ctx, frame)) == 0) {
+		if (!wait_frame(ctx))
+			return false;
 	}
 
-	return true;
+	return status > 0;
 }
 
+/*
+ * Like camera_acquire_frame(), but skips to the newest frame the source has
+ * ready. The older ones are released untouched, 'skipped' counts them. No
+ * more than the buffer count are drained, a source running as fast as
+ * possible always has one more.
+ */
 bool
-camera_read_frame(struct camera_ctx *ctx, void *dest, unsigned int dest_size)
+camera_acquire_latest_frame(struct camera_ctx *ctx, struct camera_frame *frame, unsigned int *skipped)
 {
-	fd_set fds;
-	struct timeval tv;
-	int status;
+	struct camera_frame next;
+	unsigned int i;
+	int status = 0;
 
-	if (!ctx)
+	if (skipped)
+		*skipped = 0;
+
+	if (!camera_acquire_frame(ctx, frame))
 		return false;
 
-	do {
-		FD_ZERO(&fds);
-		FD_SET(ctx->fd, &fds);
+	for (i = 1; i < ctx->buffers_nr && (status = ctx->backend->acquire(ctx, &next)) > 0; i++) {
+		if (!camera_release_frame(ctx, frame)) {
+			camera_release_frame(ctx, &next);
+			return false;
+		}
 
-		/* Timeout */
-		tv.tv_sec = 2;
-		tv.tv_usec = 0;
+		/* what the source dropped before the skipped frame, it dropped before this one */
+		next.lost += frame->lost;
+		*frame = next;
 
-		status = select(ctx->fd + 1, &fds, NULL, NULL, &tv);
-		if (status == -1) {
-			if (errno == EINTR)
-				continue;
+		if (skipped)
+			(*skipped)++;
+	}
 
-			LOG_PERROR("select");
-			return false;
-		}
+	if (status < 0) {
+		camera_release_frame(ctx, frame);
+		return false;
+	}
 
-		if (status == 0) {
-			LOG_ERROR("select timeout");
-			return false;
-		}
+	return true;
+}
 
-		status = read_frame(ctx, dest, dest_size);
-		if (status != 0)
-			break;
+bool
+camera_release_frame(struct camera_ctx *ctx, struct camera_frame *frame)
+{
+	if (!ctx || !frame)
+		return false;
 
-		/* EAGAIN - continue select loop */
-	} while(1);
+	if (!ctx->backend->release(ctx, frame))
+		return false;
+
+	frame->data = NULL;
 
-	return (status == 1) ? true : false;
+	return true;
 }
 
 uint32_t
@@ -259,251 +224,252 @@ camera_get_frame_size(struct camera_ctx *ctx)
 	if (!ctx)
 		return 0;
 
-	return camera_get_width(ctx) * camera_get_height(ctx) * PIXEL_DEPTH;
+	return format_get_frame_size(ctx->format, ctx->width, ctx->height);
 }
 
-
-/*======================================
-	Inner function
-======================================*/
-
-static bool
-open_device(struct camera_ctx *ctx)
+uint32_t
+camera_get_format(struct camera_ctx *ctx)
 {
-	struct stat st;
-
 	if (!ctx)
-		return false;
+		return 0;
 
-	if (stat(ctx->dev_name, &st) == -1) {
-		LOG_ERROR("Cannot identify '%s' : %d, %s", ctx->dev_name, errno, strerror(errno));
-		return false;
-	}
+	return ctx->format;
+}
 
-	if (!S_ISCHR(st.st_mode)) {
-		LOG_ERROR("%s is no device", ctx->dev_name);
-		return false;
-	}
+/* colour matrix of the frames, as the source describes them */
+enum convert_matrix
+camera_get_matrix(struct camera_ctx *ctx)
+{
+	if (!ctx)
+		return CONVERT_MATRIX_LEGACY;
 
-	ctx->fd = open(ctx->dev_name, O_RDWR | O_NONBLOCK, 0);
+	return ctx->matrix;
+}
 
-	if (ctx->fd < 0) {
-		LOG_ERROR("Cannot open '%s': %d, %s", ctx->dev_name, errno, strerror(errno));
-		return false;
-	}
+/* frame rate of the negotiated mode */
+double
+camera_get_fps(struct camera_ctx *ctx)
+{
+	if (!ctx)
+		return 0;
 
-	return true;
+	return ctx->fps;
 }
 
-static void
-close_device(struct camera_ctx *ctx)
+unsigned int
+camera_get_buffer_count(struct camera_ctx *ctx)
 {
 	if (!ctx)
-		return;
+		return 0;
 
-	close(ctx->fd);
+	return ctx->buffers_nr;
 }
 
-static bool
-init_device(struct camera_ctx *ctx)
+/* false when the source has no buffer queue of its own */
+bool
+camera_get_queue_stats(struct camera_ctx *ctx, struct camera_queue_stats *stats)
 {
-	struct v4l2_capability cap;
-	struct v4l2_cropcap cropcap;
-	struct v4l2_format fmt;
-
-	if (!ctx)
+	if (!ctx || !stats || !ctx->backend->get_stats)
 		return false;
 
-	if (xioctl(ctx->fd, VIDIOC_QUERYCAP, &cap) < 0) {
-		if (errno == EINVAL)
-			LOG_ERROR("%s is no V4L2 device", ctx->dev_name);
-		else
-			LOG_PERROR("VIDIOC_QUERYCAP");
+	return ctx->backend->get_stats(ctx, stats);
+}
 
-		return false;
-	}
+/* polls readable once a frame can be acquired without blocking */
+int
+camera_get_fd(struct camera_ctx *ctx)
+{
+	if (!ctx)
+		return -1;
 
-	if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
-		LOG_ERROR("%s is no video capture device", ctx->dev_name);
-		return false;
-	}
+	return ctx->backend->get_fd(ctx);
+}
 
-	if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
-		LOG_ERROR("%s does not support streaming I/O", ctx->dev_name);
-		return false;
-	}
 
-	memset(&cropcap, 0, sizeof(cropcap));
-	cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	if (xioctl(ctx->fd, VIDIOC_CROPCAP, &cropcap) == 0) {
-		struct v4l2_crop crop;
-		crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		crop.c = cropcap.defrect; /* reset to default */
+/*======================================
+	Backend function
+======================================*/
 
-		xioctl(ctx->fd, VIDIOC_S_CROP, &crop);
-	}
+/*
+ * A periodic timerfd, or for 0 fps an eventfd that is never read and so
+ * always polls readable.
+ */
+bool
+camera_timer_open(struct camera_timer *timer, unsigned int fps)
+{
+	timer->fps = fps;
 
-	memset(&fmt, 0, sizeof(fmt));
-	fmt.type				= V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	fmt.fmt.pix.width		= camera_get_width(ctx);
-	fmt.fmt.pix.height		= camera_get_height(ctx);
-	fmt.fmt.pix.pixelformat	= PIXEL_FORMAT;
-	if (xioctl(ctx->fd, VIDIOC_S_FMT, &fmt) < 0) {
-		LOG_PERROR("VIDIOC_S_FMT");
+	if (fps)
+		timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	else
+		timer->fd = eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (timer->fd < 0) {
+		LOG_PERROR(fps ? "timerfd_create" : "eventfd");
 		return false;
 	}
 
-	return init_mmap(ctx);
+	return true;
 }
 
-static void
-terminate_device(struct camera_ctx *ctx)
+void
+camera_timer_close(struct camera_timer *timer)
 {
-	int i;
-
-	if (!ctx)
-		return;
-
-	for (i = 0; i < ctx->buffers_nr; i++)
-		if (munmap(ctx->buffers[i].start, ctx->buffers[i].length) < 0)
-			LOG_PERROR("munmap");
+	if (timer->fd >= 0)
+		close(timer->fd);
+	timer->fd = -1;
 }
 
-static bool
-init_mmap(struct camera_ctx *ctx)
+/*
+ * The first frame is due one period from now. The timer runs on absolute
+ * time, so frame n is due at start + n * period however late it is read.
+ */
+bool
+camera_timer_start(struct camera_timer *timer)
 {
-	struct v4l2_requestbuffers req;
+	struct itimerspec its = { 0 };
+	uint64_t first;
 
-	if (!ctx)
-		return false;
+	if (!timer->fps)
+		return true;
 
-	memset(&req, 0, sizeof(req));
-	req.count = 4;
-	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	req.memory = V4L2_MEMORY_MMAP;
-	if (xioctl(ctx->fd, VIDIOC_REQBUFS, &req) < 0) {
-		if (errno == EINVAL)
-			LOG_ERROR("%s does not support memory mapping", ctx->dev_name);
-		else
-			LOG_PERROR("VIDIOC_REQBUFS");
+	timer->period	= 1000000000ULL / timer->fps;
+	timer->start	= util_get_time();
+	timer->ticks	= 0;
 
-		return false;
-	}
+	first = timer->start + timer->period;
+	its.it_interval.tv_sec	= timer->period / 1000000000ULL;
+	its.it_interval.tv_nsec	= timer->period % 1000000000ULL;
+	its.it_value.tv_sec		= first / 1000000000ULL;
+	its.it_value.tv_nsec	= first % 1000000000ULL;
 
-	if (req.count < 2) {
-		LOG_ERROR("Insufficient buffer memory on %s", ctx->dev_name);
+	if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		LOG_PERROR("timerfd_settime");
 		return false;
 	}
 
-	ctx->buffers = calloc(req.count, sizeof(struct buffer));
-	if (!ctx->buffers) {
-		LOG_ERROR("Out of memory");
-		return false;
-	}
+	return true;
+}
 
-	for (ctx->buffers_nr = 0; ctx->buffers_nr < req.count; ctx->buffers_nr++) {
-		struct v4l2_buffer buf;
+bool
+camera_timer_stop(struct camera_timer *timer)
+{
+	struct itimerspec its = { 0 };
 
-		memset(&buf, 0, sizeof(buf));
-		buf.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory	= V4L2_MEMORY_MMAP;
-		buf.index	= ctx->buffers_nr;
-		if (xioctl(ctx->fd, VIDIOC_QUERYBUF, &buf) < 0) {
-			LOG_PERROR("VIDIOC_QUERYBUF");
-			return false;
-		}
+	if (!timer->fps)
+		return true;
 
-		ctx->buffers[ctx->buffers_nr].length = buf.length;
-		ctx->buffers[ctx->buffers_nr].start =
-			mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->fd, buf.m.offset);
-		if (ctx->buffers[ctx->buffers_nr].start == MAP_FAILED) {
-			LOG_PERROR("mmap");
-			return false;
-		}
+	if (timerfd_settime(timer->fd, 0, &its, NULL) < 0) {
+		LOG_PERROR("timerfd_settime");
+		return false;
 	}
 
 	return true;
 }
 
-static int
-read_frame(struct camera_ctx *ctx, void *dest, unsigned int dest_size)
+/*
+ * Periods elapsed since the last call, 0 : the next frame is not due yet.
+ * 'due' is when the last of them expired, not when it was read.
+ */
+int
+camera_timer_ticks(struct camera_timer *timer, uint64_t *due)
 {
-	struct v4l2_buffer buf;
+	uint64_t ticks;
 
-	if (!ctx)
-		return -1;
+	if (!timer->fps) {
+		*due = util_get_time();
+		return 1;
+	}
 
-	memset(&buf, 0, sizeof(buf));
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	buf.memory = V4L2_MEMORY_MMAP;
-	if (xioctl(ctx->fd, VIDIOC_DQBUF, &buf) < 0) {
-		if (errno == EAGAIN) {
+	if (read(timer->fd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+		if (errno == EAGAIN)
 			return 0;
-		} else {
-			LOG_PERROR("VIDIOC_DQBUF");
-			return -1;
-		}
-	}
 
-	if (buf.index >= ctx->buffers_nr) {
-		LOG_ERROR("buf.index(%u) >= buffers_nr(%u)", buf.index, ctx->buffers_nr);
+		LOG_PERROR("read");
 		return -1;
 	}
 
-	if (dest) {
-		if (dest_size < buf.bytesused) {
-			LOG_ERROR("dest_size(%u) < buf.bytesused(%u)", dest_size, buf.bytesused);
-			return -1;
-		}
+	timer->ticks += ticks;
+	*due = timer->start + timer->ticks * timer->period;
 
-		memcpy(dest, ctx->buffers[buf.index].start, buf.bytesused);
-	}
+	return ticks > 0x7fffffff ? 0x7fffffff : (int)ticks;
+}
 
-	if (xioctl(ctx->fd, VIDIOC_QBUF, &buf) < 0) {
-		LOG_PERROR("VIDIOC_QBUF");
-		return -1;
+/*
+ * The format forced by the configuration, else the first of 'formats' the
+ * source 'supported'. False when there is none.
+ */
+bool
+camera_choose_format(const struct camera_config *config, const uint32_t *supported,
+	unsigned int supported_nr, const uint32_t *formats, unsigned int formats_nr, uint32_t *format)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < formats_nr; i++) {
+		if (config->format && formats[i] != config->format)
+			continue;
+
+		for (j = 0; j < supported_nr; j++) {
+			if (supported[j] == formats[i]) {
+				*format = formats[i];
+				return true;
+			}
+		}
 	}
 
-	return 1;
-}
+	if (config->format)
+		LOG_ERROR("%s cannot be captured and converted", format_get_name(config->format));
 
-static bool
-get_frame_size(struct camera_ctx *ctx)
-{
-	struct v4l2_frmsizeenum fmt;
+	return false;
+}
 
-	if (!ctx)
-		return false;
 
-	memset(&fmt, 0, sizeof(fmt));
-	fmt.index = 0;
-	fmt.pixel_format = PIXEL_FORMAT;
+/*======================================
+	Inner function
+======================================*/
 
-	if (xioctl(ctx->fd, VIDIOC_ENUM_FRAMESIZES, &fmt) < 0) {
-		LOG_PERROR("VIDIOC_ENUM_FRAMESIZES");
-		return false;
+/* "file:<path>", "pattern", anything else is a V4L2 device */
+static const struct camera_backend *
+find_backend(const char *name, const char **arg)
+{
+	if (strncmp(name, "file:", 5) == 0) {
+		*arg = name + 5;
+		return &camera_file_backend;
 	}
 
-	if (fmt.type != V4L2_FRMSIZE_TYPE_DISCRETE) {
-		LOG_ERROR("Unknown TYPE");
-		return false;	
+	if (strcmp(name, "pattern") == 0) {
+		*arg = name;
+		return &camera_pattern_backend;
 	}
 
-	ctx->width	= fmt.discrete.width;
-	ctx->height	= fmt.discrete.height;
-
-	return true;
+	*arg = name;
+	return &camera_v4l2_backend;
 }
 
-static int
-xioctl(int fh, int request, void *arg)
+static bool
+wait_frame(struct camera_ctx *ctx)
 {
-	int r;
+	struct pollfd pfd;
+	int status;
+
+	pfd.fd		= camera_get_fd(ctx);
+	pfd.events	= POLLIN;
 
 	do {
-		r = ioctl(fh, request, arg);
-	} while ((r < 0) && (errno == EINTR));
+		status = poll(&pfd, 1, WAIT_TIMEOUT);
+		if (status == -1) {
+			if (errno == EINTR)
+				continue;
 
-	return r;
-}
+			LOG_PERROR("poll");
+			return false;
+		}
 
+		if (status == 0) {
+			LOG_ERROR("poll timeout");
+			return false;
+		}
+	} while (status <= 0);
+
+	return true;
+}
@@ -28,14 +28,66 @@
 	Header include
 ======================================*/
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "convert.h"
+
 /*======================================
 	Structure
 ======================================*/
 
 struct camera_ctx;
 
+/* what a device mode is chosen for once the minimums are met */
+enum camera_prefer {
+	CAMERA_PREFER_DEFAULT = 0,	/* as fps, but without a size or rate the format order first */
+	CAMERA_PREFER_SIZE,			/* the largest frames, then the highest rate */
+	CAMERA_PREFER_FPS			/* the highest rate, then the largest frames */
+};
+
+/*
+ * 'name' is a V4L2 device, "file:<path>" to replay a raw dump of packed
+ * frames, or "pattern" for generated colour bars. Zero fields are left to
+ * the source. A device takes the size and rate as minimums, and picks the
+ * best mode it offers above them.
+ */
+struct camera_config {
+	const char	   *name;
+	uint32_t		width, height;
+	uint32_t		format;		/* FORMAT_* fourcc */
+	int				fps;		/* -1 : default, 0 : as fast as possible */
+	enum camera_prefer	prefer;	/* device only */
+	unsigned int	buffers;	/* device queue depth, 0 : default */
+	unsigned int	buffers_max;	/* > buffers : adapted between both */
+};
+
+/* of the device buffer queue, sampled after some dequeues */
+struct camera_queue_stats {
+	unsigned int	depth;		/* buffers now */
+	unsigned int	resizes;	/* restreams to change the depth */
+	uint64_t		frames;		/* dequeued */
+	uint64_t		samples;	/* dequeues the queue was looked at */
+	uint64_t		queued_sum;	/* buffers the driver had left to fill, over every sample */
+	unsigned int	queued_min;
+	uint64_t		done_sum;	/* filled and waiting to be dequeued, likewise */
+	unsigned int	done_max;
+};
+
+/*
+ * A captured frame, the data stays valid until camera_release_frame().
+ * Up to camera_get_buffer_count() frames may be held at the same time.
+ */
+struct camera_frame {
+	void		   *data;
+	unsigned int	bytesused;
+	unsigned int	index;
+	uint32_t		sequence;	/* source frame counter */
+	uint32_t		lost;		/* frames the source dropped right before this one */
+	uint64_t		timestamp;	/* capture time, CLOCK_MONOTONIC [ns] */
+	bool			error;		/* the source flagged the data as damaged */
+};
+
 /*======================================
 	Prototype
 ======================================*/
@@ -44,17 +96,25 @@ struct camera_ctx;
 extern "C" {
 #endif /* __cplusplus */
 
-struct camera_ctx *camera_init(char *dev_name);
+struct camera_ctx *camera_init(const struct camera_config *config, const uint32_t *formats, unsigned int formats_nr);
 void camera_terminate(struct camera_ctx *ctx);
 
 bool camera_start_capturing(struct camera_ctx *ctx);
 bool camera_stop_capturing(struct camera_ctx *ctx);
 
-bool camera_read_frame(struct camera_ctx *ctx, void *dest, unsigned int dest_size);
+bool camera_acquire_frame(struct camera_ctx *ctx, struct camera_frame *frame);
+bool camera_acquire_latest_frame(struct camera_ctx *ctx, struct camera_frame *frame, unsigned int *skipped);
+bool camera_release_frame(struct camera_ctx *ctx, struct camera_frame *frame);
 
 uint32_t camera_get_width(struct camera_ctx *ctx);
 uint32_t camera_get_height(struct camera_ctx *ctx);
 uint32_t camera_get_frame_size(struct camera_ctx *ctx);
+uint32_t camera_get_format(struct camera_ctx *ctx);
+enum convert_matrix camera_get_matrix(struct camera_ctx *ctx);
+double camera_get_fps(struct camera_ctx *ctx);
+unsigned int camera_get_buffer_count(struct camera_ctx *ctx);
+bool camera_get_queue_stats(struct camera_ctx *ctx, struct camera_queue_stats *stats);
+int camera_get_fd(struct camera_ctx *ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,107 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+#ifndef _CAMERA_BACKEND_H
+#define _CAMERA_BACKEND_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "camera.h"
+#include "convert.h"
+
+
+/*======================================
+	Structure
+======================================*/
+
+/*
+ * What a frame source implements, camera.c does the rest. open() fills in
+ * the format, size, matrix and buffer count of the context.
+ */
+struct camera_backend {
+	const char *name;
+
+	bool	(*open)(struct camera_ctx *ctx, const struct camera_config *config,
+				const uint32_t *formats, unsigned int formats_nr);
+	void	(*close)(struct camera_ctx *ctx);
+	bool	(*start)(struct camera_ctx *ctx);
+	bool	(*stop)(struct camera_ctx *ctx);
+
+	/* 1 : frame, 0 : none ready yet, the fd polls readable once there is, -1 : error */
+	int		(*acquire)(struct camera_ctx *ctx, struct camera_frame *frame);
+	bool	(*release)(struct camera_ctx *ctx, struct camera_frame *frame);
+	int		(*get_fd)(struct camera_ctx *ctx);
+
+	/* optional, NULL : no queue to tell about */
+	bool	(*get_stats)(struct camera_ctx *ctx, struct camera_queue_stats *stats);
+};
+
+struct camera_ctx {
+	const struct camera_backend *backend;
+	void		   *priv;		/* the backend's */
+
+	uint32_t		format;		/* FORMAT_* fourcc */
+	uint32_t		width, height;
+	enum convert_matrix	matrix;
+	double			fps;		/* nominal, 0 : unknown or as fast as possible */
+	unsigned int	buffers_nr;	/* frames that may be held at the same time */
+};
+
+/* frame pacing of the sources without a device, 0 fps : as fast as possible */
+struct camera_timer {
+	int				fd;
+	unsigned int	fps;
+	uint64_t		start;		/* CLOCK_MONOTONIC [ns], the first frame is due a period after */
+	uint64_t		period;		/* [ns] */
+	uint64_t		ticks;		/* periods elapsed since the start */
+};
+
+
+/*======================================
+	Variable
+======================================*/
+
+extern const struct camera_backend camera_v4l2_backend;
+extern const struct camera_backend camera_file_backend;
+extern const struct camera_backend camera_pattern_backend;
+
+
+/*======================================
+	Prototype
+======================================*/
+
+bool camera_timer_open(struct camera_timer *timer, unsigned int fps);
+void camera_timer_close(struct camera_timer *timer);
+bool camera_timer_start(struct camera_timer *timer);
+bool camera_timer_stop(struct camera_timer *timer);
+int camera_timer_ticks(struct camera_timer *timer, uint64_t *due);
+
+bool camera_choose_format(const struct camera_config *config, const uint32_t *supported,
+	unsigned int supported_nr, const uint32_t *formats, unsigned int formats_nr, uint32_t *format);
+
+#endif /* _CAMERA_BACKEND_H */
@@ -0,0 +1,492 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "camera.h"
+#include "camera_backend.h"
+#include "format.h"
+
+/*======================================
+	Constant
+======================================*/
+
+#define DEFAULT_WIDTH		640
+#define DEFAULT_HEIGHT		480
+
+#define FILE_BUFFERS		4	/* frames that may be held, they are all in the mapping */
+
+#define JPEG_SOI			0xd8
+#define JPEG_EOI			0xd9
+#define JPEG_SOS			0xda
+
+
+/*======================================
+	Structure
+======================================*/
+
+/* where an MJPEG frame lies in the dump */
+struct file_frame {
+	size_t			offset;
+	size_t			size;
+};
+
+/* a raw dump of packed frames or of JPEG images back to back, played in a loop */
+struct file_camera {
+	const char	   *path;
+	uint8_t		   *data;		/* read only */
+	size_t			size;
+	size_t			frame_size;	/* packed frames */
+	struct file_frame *frames;	/* MJPEG, NULL for packed frames */
+	unsigned int	frames_nr;
+
+	struct camera_timer	timer;
+	uint32_t		sequence;	/* of the next frame */
+	unsigned int	held_nr;
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static bool file_open(struct camera_ctx *ctx, const struct camera_config *config,
+	const uint32_t *formats, unsigned int formats_nr);
+static void file_close(struct camera_ctx *ctx);
+static bool file_start(struct camera_ctx *ctx);
+static bool file_stop(struct camera_ctx *ctx);
+static int file_acquire(struct camera_ctx *ctx, struct camera_frame *frame);
+static bool file_release(struct camera_ctx *ctx, struct camera_frame *frame);
+static int file_get_fd(struct camera_ctx *ctx);
+static bool count_frames(struct camera_ctx *ctx, struct file_camera *cam);
+static bool index_jpegs(struct camera_ctx *ctx, struct file_camera *cam, bool sized);
+static const uint8_t *find_jpeg(const uint8_t *p, size_t size);
+static size_t get_jpeg_size(const uint8_t *p, size_t size, uint32_t *width, uint32_t *height);
+static size_t skip_scan(const uint8_t *p, size_t pos, size_t size);
+
+
+/*======================================
+	Variable
+======================================*/
+
+const struct camera_backend camera_file_backend = {
+	.name		= "file",
+	.open		= file_open,
+	.close		= file_close,
+	.start		= file_start,
+	.stop		= file_stop,
+	.acquire	= file_acquire,
+	.release	= file_release,
+	.get_fd		= file_get_fd,
+};
+
+/* anything with a fixed frame size, and MJPEG */
+static const uint32_t file_formats[] = {
+	FORMAT_YUYV, FORMAT_UYVY, FORMAT_NV12, FORMAT_NV21, FORMAT_YUV420, FORMAT_GREY, FORMAT_MJPEG,
+};
+
+
+/*======================================
+	Inner function
+======================================*/
+
+/*
+ * A raw dump carries no header, the format (YUYV by default) and the size
+ * come from the configuration and have to match how it was recorded. An
+ * MJPEG dump takes its size from the first image unless one is configured.
+ */
+static bool
+file_open(struct camera_ctx *ctx, const struct camera_config *config,
+	const uint32_t *formats, unsigned int formats_nr)
+{
+	struct camera_config conf = *config;
+	struct file_camera *cam;
+	struct stat st;
+	unsigned int i;
+	int fd;
+
+	if (!conf.format)
+		conf.format = FORMAT_YUYV;
+
+	for (i = 0; i < sizeof(file_formats) / sizeof(file_formats[0]); i++)
+		if (file_formats[i] == conf.format)
+			break;
+
+	if (i == sizeof(file_formats) / sizeof(file_formats[0])) {
+		LOG_ERROR("Cannot replay %s frames", format_get_name(conf.format));
+		return false;
+	}
+
+	if (!camera_choose_format(&conf, file_formats, sizeof(file_formats) / sizeof(file_formats[0]),
+			formats, formats_nr, &ctx->format))
+		return false;
+
+	ctx->width	= conf.width ? conf.width : DEFAULT_WIDTH;
+	ctx->height	= conf.height ? conf.height : DEFAULT_HEIGHT;
+	ctx->matrix	= CONVERT_MATRIX_BT601_LIMITED;
+	ctx->fps	= conf.fps;
+	ctx->buffers_nr = FILE_BUFFERS;
+
+	cam = (struct file_camera *)calloc(1, sizeof(struct file_camera));
+	if (!cam) {
+		LOG_ERROR("Out of Memory");
+		return false;
+	}
+
+	cam->path = conf.name;
+
+	fd = open(cam->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOG_ERROR("Cannot open '%s' : %d, %s", cam->path, errno, strerror(errno));
+		free(cam);
+		return false;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		LOG_PERROR("fstat");
+		goto err;
+	}
+
+	cam->size = st.st_size;
+	if (!cam->size) {
+		LOG_ERROR("%s is empty", cam->path);
+		goto err;
+	}
+
+	cam->data = mmap(NULL, cam->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (cam->data == MAP_FAILED) {
+		LOG_PERROR("mmap");
+		goto err;
+	}
+
+	/* read ahead now rather than fault the pages in on the first loop */
+	madvise(cam->data, cam->size, MADV_WILLNEED);
+	close(fd);
+
+	if (ctx->format == FORMAT_MJPEG ? !index_jpegs(ctx, cam, conf.width && conf.height)
+		: !count_frames(ctx, cam))
+		goto err_unmap;
+
+	if (!camera_timer_open(&cam->timer, conf.fps))
+		goto err_unmap;
+
+	ctx->priv = cam;
+
+	return true;
+
+err_unmap:
+	free(cam->frames);
+	munmap(cam->data, cam->size);
+	free(cam);
+	return false;
+
+err:
+	close(fd);
+	free(cam);
+	return false;
+}
+
+static void
+file_close(struct camera_ctx *ctx)
+{
+	struct file_camera *cam = ctx->priv;
+
+	camera_timer_close(&cam->timer);
+	free(cam->frames);
+	munmap(cam->data, cam->size);
+	free(cam);
+	ctx->priv = NULL;
+}
+
+static bool
+file_start(struct camera_ctx *ctx)
+{
+	struct file_camera *cam = ctx->priv;
+
+	return camera_timer_start(&cam->timer);
+}
+
+static bool
+file_stop(struct camera_ctx *ctx)
+{
+	struct file_camera *cam = ctx->priv;
+
+	cam->held_nr = 0;
+
+	return camera_timer_stop(&cam->timer);
+}
+
+/* frames that were due while nobody asked are skipped, like a driver drops them */
+static int
+file_acquire(struct camera_ctx *ctx, struct camera_frame *frame)
+{
+	struct file_camera *cam = ctx->priv;
+	unsigned int index;
+	uint64_t due;
+	int ticks;
+
+	if (cam->held_nr >= ctx->buffers_nr) {
+		LOG_ERROR("all %u buffers are held", ctx->buffers_nr);
+		return -1;
+	}
+
+	ticks = camera_timer_ticks(&cam->timer, &due);
+	if (ticks <= 0)
+		return ticks;
+
+	cam->sequence += ticks - 1;
+	index = cam->sequence % cam->frames_nr;
+
+	if (cam->frames) {
+		frame->data			= cam->data + cam->frames[index].offset;
+		frame->bytesused	= cam->frames[index].size;
+	} else {
+		frame->data			= cam->data + (size_t)index * cam->frame_size;
+		frame->bytesused	= cam->frame_size;
+	}
+	frame->index		= 0;
+	frame->sequence		= cam->sequence++;
+	frame->lost			= ticks - 1;
+	frame->timestamp	= due;
+	frame->error		= false;
+
+	cam->held_nr++;
+
+	return 1;
+}
+
+static bool
+file_release(struct camera_ctx *ctx, struct camera_frame *frame)
+{
+	struct file_camera *cam = ctx->priv;
+
+	if (!cam->held_nr) {
+		LOG_ERROR("no frame is held");
+		return false;
+	}
+
+	cam->held_nr--;
+
+	return true;
+}
+
+static int
+file_get_fd(struct camera_ctx *ctx)
+{
+	struct file_camera *cam = ctx->priv;
+
+	return cam->timer.fd;
+}
+
+static bool
+count_frames(struct camera_ctx *ctx, struct file_camera *cam)
+{
+	cam->frame_size = format_get_frame_size(ctx->format, ctx->width, ctx->height);
+	cam->frames_nr = cam->size / cam->frame_size;
+	if (!cam->frames_nr) {
+		LOG_ERROR("%s holds no %ux%u %s frame", cam->path, ctx->width, ctx->height,
+				format_get_name(ctx->format));
+		return false;
+	}
+
+	if (cam->size % cam->frame_size)
+		LOG_ERROR("%s : %zu trailing bytes ignored, is it %ux%u %s?", cam->path,
+				cam->size % cam->frame_size, ctx->width, ctx->height, format_get_name(ctx->format));
+
+	return true;
+}
+
+/*
+ * An MJPEG dump is JPEG images back to back, as ffmpeg -f mjpeg writes them
+ * or as the V4L2 buffers were saved. Every image is found by walking its
+ * markers up to EOI, each is replayed with its own bytesused.
+ */
+static bool
+index_jpegs(struct camera_ctx *ctx, struct file_camera *cam, bool sized)
+{
+	struct file_frame *frames = NULL, *tmp;
+	unsigned int frames_max = 0;
+	uint32_t width = 0, height = 0, w, h;
+	size_t pos = 0, used = 0, size;
+	const uint8_t *soi;
+
+	while ((soi = find_jpeg(cam->data + pos, cam->size - pos)) != NULL) {
+		pos = soi - cam->data;
+
+		w = h = 0;
+		size = get_jpeg_size(soi, cam->size - pos, &w, &h);
+		if (!size) {
+			/* cut short or broken, look for the next image */
+			pos += 2;
+			continue;
+		}
+
+		if (cam->frames_nr == frames_max) {
+			frames_max = frames_max ? frames_max * 2 : 64;
+			tmp = realloc(frames, frames_max * sizeof(*frames));
+			if (!tmp) {
+				LOG_ERROR("Out of Memory");
+				free(frames);
+				return false;
+			}
+			frames = tmp;
+		}
+
+		/* the first image gives the size */
+		if (!cam->frames_nr) {
+			width	= w;
+			height	= h;
+		}
+
+		frames[cam->frames_nr].offset	= pos;
+		frames[cam->frames_nr].size		= size;
+		cam->frames_nr++;
+
+		pos		+= size;
+		used	+= size;
+	}
+
+	if (!cam->frames_nr || !width || !height) {
+		LOG_ERROR("%s holds no JPEG image", cam->path);
+		free(frames);
+		return false;
+	}
+
+	if (used < cam->size)
+		LOG_ERROR("%s : %zu bytes outside of JPEG images ignored", cam->path, cam->size - used);
+
+	if (!sized) {
+		ctx->width	= width;
+		ctx->height	= height;
+	}
+
+	cam->frames = frames;
+
+	return true;
+}
+
+/* next SOI followed by a marker, NULL when there is none */
+static const uint8_t *
+find_jpeg(const uint8_t *p, size_t size)
+{
+	const uint8_t *end = p + size;
+
+	while (end - p >= 3) {
+		p = memchr(p, 0xff, end - p - 2);
+		if (!p)
+			return NULL;
+
+		if (p[1] == JPEG_SOI && p[2] == 0xff)
+			return p;
+
+		p++;
+	}
+
+	return NULL;
+}
+
+/* bytes of the JPEG image at 'p' up to its EOI, 0 when it is cut short or broken */
+static size_t
+get_jpeg_size(const uint8_t *p, size_t size, uint32_t *width, uint32_t *height)
+{
+	size_t pos = 2, len;
+	uint8_t marker;
+
+	while (pos + 2 <= size) {
+		if (p[pos] != 0xff)
+			return 0;
+
+		marker = p[pos + 1];
+
+		/* fill byte */
+		if (marker == 0xff) {
+			pos++;
+			continue;
+		}
+
+		if (marker == JPEG_EOI)
+			return pos + 2;
+
+		/* TEM and RSTn stand alone */
+		if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+			pos += 2;
+			continue;
+		}
+
+		if (pos + 4 > size)
+			return 0;
+
+		len = (size_t)p[pos + 2] << 8 | p[pos + 3];
+		if (len < 2 || pos + 2 + len > size)
+			return 0;
+
+		/* SOFn, but DHT, JPG and DAC share the range */
+		if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc
+			&& len >= 7) {
+			*height	= (uint32_t)p[pos + 5] << 8 | p[pos + 6];
+			*width	= (uint32_t)p[pos + 7] << 8 | p[pos + 8];
+		}
+
+		pos += 2 + len;
+
+		if (marker == JPEG_SOS)
+			pos = skip_scan(p, pos, size);
+	}
+
+	return 0;
+}
+
+/* entropy-coded data up to the next marker, FF00 is a stuffed byte and RSTn sit inside */
+static size_t
+skip_scan(const uint8_t *p, size_t pos, size_t size)
+{
+	const uint8_t *ff;
+
+	while (pos < size && (ff = memchr(p + pos, 0xff, size - pos)) != NULL) {
+		pos = ff - p;
+		if (pos + 1 >= size)
+			return size;
+
+		if (p[pos + 1] != 0 && (p[pos + 1] < 0xd0 || p[pos + 1] > 0xd7))
+			return pos;
+
+		pos += 2;
+	}
+
+	return size;
+}
@@ -0,0 +1,403 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "camera.h"
+#include "camera_backend.h"
+#include "format.h"
+
+/*======================================
+	Constant
+======================================*/
+
+#define DEFAULT_WIDTH		640
+#define DEFAULT_HEIGHT		480
+
+#define PATTERN_BUFFERS		4
+#define PLANE_MAX			3
+#define BOX_STEP			4	/* pixels per frame */
+
+
+/*======================================
+	Structure
+======================================*/
+
+/* BT.601 limited range */
+struct yuv {
+	uint8_t y, u, v;
+};
+
+/*
+ * Where a plane is in a frame and what two horizontally adjacent pixels
+ * look like in it : 'pair' bytes of 'sample', rows subsampled by 'vshift'.
+ */
+struct plane {
+	size_t			offset;
+	size_t			stride;
+	unsigned int	pair;
+	unsigned int	vshift;
+	uint8_t			sample[4];
+};
+
+/* 75% colour bars with a box sweeping across, so that every frame differs */
+struct pattern_camera {
+	uint8_t		   *background;		/* the bars */
+	uint8_t		   *buffers[PATTERN_BUFFERS];
+	bool			held[PATTERN_BUFFERS];
+	int				box_x[PATTERN_BUFFERS];	/* drawn at, -1 : nothing rendered yet */
+	unsigned int	held_nr;
+
+	size_t			frame_size;
+	uint32_t		box_size, box_y;
+
+	struct camera_timer	timer;
+	uint32_t		sequence;	/* of the next frame */
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static bool pattern_open(struct camera_ctx *ctx, const struct camera_config *config,
+	const uint32_t *formats, unsigned int formats_nr);
+static void pattern_close(struct camera_ctx *ctx);
+static bool pattern_start(struct camera_ctx *ctx);
+static bool pattern_stop(struct camera_ctx *ctx);
+static int pattern_acquire(struct camera_ctx *ctx, struct camera_frame *frame);
+static bool pattern_release(struct camera_ctx *ctx, struct camera_frame *frame);
+static int pattern_get_fd(struct camera_ctx *ctx);
+
+static unsigned int get_planes(struct camera_ctx *ctx, const struct yuv *colour, struct plane *planes);
+static void fill_rect(struct camera_ctx *ctx, uint8_t *data, uint32_t x, uint32_t y, uint32_t width,
+	uint32_t height, const struct yuv *colour);
+static void copy_rect(struct camera_ctx *ctx, uint8_t *dst, const uint8_t *src, uint32_t x, uint32_t y,
+	uint32_t width, uint32_t height);
+static void render(struct camera_ctx *ctx, unsigned int index, uint32_t sequence);
+
+
+/*======================================
+	Variable
+======================================*/
+
+const struct camera_backend camera_pattern_backend = {
+	.name		= "pattern",
+	.open		= pattern_open,
+	.close		= pattern_close,
+	.start		= pattern_start,
+	.stop		= pattern_stop,
+	.acquire	= pattern_acquire,
+	.release	= pattern_release,
+	.get_fd		= pattern_get_fd,
+};
+
+static const uint32_t pattern_formats[] = {
+	FORMAT_YUYV, FORMAT_UYVY, FORMAT_NV12, FORMAT_NV21, FORMAT_YUV420, FORMAT_GREY,
+};
+
+/* white, yellow, cyan, green, magenta, red, blue, black */
+static const struct yuv bars[] = {
+	{ 180, 128, 128 }, { 162,  44, 142 }, { 131, 156,  44 }, { 112,  72,  58 },
+	{  84, 184, 198 }, {  65, 100, 212 }, {  35, 212, 114 }, {  16, 128, 128 },
+};
+
+static const struct yuv box_colour = { 235, 128, 128 };
+
+
+/*======================================
+	Inner function
+======================================*/
+
+/* any even size, the first of the caller's formats it can draw */
+static bool
+pattern_open(struct camera_ctx *ctx, const struct camera_config *config,
+	const uint32_t *formats, unsigned int formats_nr)
+{
+	struct pattern_camera *cam;
+	uint32_t x0, x1;
+	unsigned int i;
+
+	if (!camera_choose_format(config, pattern_formats, sizeof(pattern_formats) / sizeof(pattern_formats[0]),
+			formats, formats_nr, &ctx->format)) {
+		if (!config->format)
+			LOG_ERROR("pattern offers no supported pixel format");
+		return false;
+	}
+
+	ctx->width	= config->width ? config->width : DEFAULT_WIDTH;
+	ctx->height	= config->height ? config->height : DEFAULT_HEIGHT;
+	ctx->matrix	= CONVERT_MATRIX_BT601_LIMITED;
+	ctx->fps	= config->fps;
+	ctx->buffers_nr = PATTERN_BUFFERS;
+
+	if ((ctx->width & 1) || (ctx->height & 1) || ctx->width < 16 || ctx->height < 16) {
+		LOG_ERROR("Unsupported pattern size %ux%u", ctx->width, ctx->height);
+		return false;
+	}
+
+	cam = (struct pattern_camera *)calloc(1, sizeof(struct pattern_camera));
+	if (!cam) {
+		LOG_ERROR("Out of Memory");
+		return false;
+	}
+
+	ctx->priv = cam;
+	cam->timer.fd = -1;
+	cam->frame_size = format_get_frame_size(ctx->format, ctx->width, ctx->height);
+	cam->box_size = (ctx->height / 6) & ~1U;
+	cam->box_y = ((ctx->height - cam->box_size) / 2) & ~1U;
+
+	cam->background = malloc(cam->frame_size);
+	if (!cam->background)
+		goto err;
+
+	for (i = 0; i < PATTERN_BUFFERS; i++) {
+		cam->buffers[i] = malloc(cam->frame_size);
+		if (!cam->buffers[i])
+			goto err;
+
+		cam->box_x[i] = -1;
+	}
+
+	for (i = 0; i < sizeof(bars) / sizeof(bars[0]); i++) {
+		x0 = (ctx->width * i / 8) & ~1U;
+		x1 = (ctx->width * (i + 1) / 8) & ~1U;
+		if (i == sizeof(bars) / sizeof(bars[0]) - 1)
+			x1 = ctx->width;
+
+		fill_rect(ctx, cam->background, x0, 0, x1 - x0, ctx->height, &bars[i]);
+	}
+
+	if (!camera_timer_open(&cam->timer, config->fps)) {
+		pattern_close(ctx);
+		return false;
+	}
+
+	return true;
+
+err:
+	LOG_ERROR("Out of Memory");
+	pattern_close(ctx);
+	return false;
+}
+
+static void
+pattern_close(struct camera_ctx *ctx)
+{
+	struct pattern_camera *cam = ctx->priv;
+	unsigned int i;
+
+	camera_timer_close(&cam->timer);
+
+	for (i = 0; i < PATTERN_BUFFERS; i++)
+		free(cam->buffers[i]);
+	free(cam->background);
+	free(cam);
+	ctx->priv = NULL;
+}
+
+static bool
+pattern_start(struct camera_ctx *ctx)
+{
+	struct pattern_camera *cam = ctx->priv;
+
+	return camera_timer_start(&cam->timer);
+}
+
+static bool
+pattern_stop(struct camera_ctx *ctx)
+{
+	struct pattern_camera *cam = ctx->priv;
+	unsigned int i;
+
+	for (i = 0; i < PATTERN_BUFFERS; i++)
+		cam->held[i] = false;
+	cam->held_nr = 0;
+
+	return camera_timer_stop(&cam->timer);
+}
+
+/* late frames are skipped, the box is where it would have been */
+static int
+pattern_acquire(struct camera_ctx *ctx, struct camera_frame *frame)
+{
+	struct pattern_camera *cam = ctx->priv;
+	unsigned int i;
+	uint64_t due;
+	int ticks;
+
+	for (i = 0; i < PATTERN_BUFFERS; i++)
+		if (!cam->held[i])
+			break;
+
+	if (i == PATTERN_BUFFERS) {
+		LOG_ERROR("all %u buffers are held", PATTERN_BUFFERS);
+		return -1;
+	}
+
+	ticks = camera_timer_ticks(&cam->timer, &due);
+	if (ticks <= 0)
+		return ticks;
+
+	cam->sequence += ticks - 1;
+
+	render(ctx, i, cam->sequence);
+
+	cam->held[i] = true;
+	cam->held_nr++;
+
+	frame->data			= cam->buffers[i];
+	frame->bytesused	= cam->frame_size;
+	frame->index		= i;
+	frame->sequence		= cam->sequence++;
+	frame->lost			= ticks - 1;
+	frame->timestamp	= due;
+	frame->error		= false;
+
+	return 1;
+}
+
+static bool
+pattern_release(struct camera_ctx *ctx, struct camera_frame *frame)
+{
+	struct pattern_camera *cam = ctx->priv;
+
+	if (frame->index >= PATTERN_BUFFERS || !cam->held[frame->index]) {
+		LOG_ERROR("buffer %u is not held", frame->index);
+		return false;
+	}
+
+	cam->held[frame->index] = false;
+	cam->held_nr--;
+
+	return true;
+}
+
+static int
+pattern_get_fd(struct camera_ctx *ctx)
+{
+	struct pattern_camera *cam = ctx->priv;
+
+	return cam->timer.fd;
+}
+
+static unsigned int
+get_planes(struct camera_ctx *ctx, const struct yuv *c, struct plane *planes)
+{
+	size_t luma = (size_t)ctx->width * ctx->height;
+	uint8_t y = c ? c->y : 0, u = c ? c->u : 0, v = c ? c->v : 0;
+
+	switch (ctx->format) {
+	case FORMAT_YUYV:
+		planes[0] = (struct plane){ 0, ctx->width * 2, 4, 0, { y, u, y, v } };
+		return 1;
+	case FORMAT_UYVY:
+		planes[0] = (struct plane){ 0, ctx->width * 2, 4, 0, { u, y, v, y } };
+		return 1;
+	case FORMAT_NV12:
+	case FORMAT_NV21:
+		planes[0] = (struct plane){ 0, ctx->width, 2, 0, { y, y } };
+		if (ctx->format == FORMAT_NV12)
+			planes[1] = (struct plane){ luma, ctx->width, 2, 1, { u, v } };
+		else
+			planes[1] = (struct plane){ luma, ctx->width, 2, 1, { v, u } };
+		return 2;
+	case FORMAT_YUV420:
+		planes[0] = (struct plane){ 0, ctx->width, 2, 0, { y, y } };
+		planes[1] = (struct plane){ luma, ctx->width / 2, 1, 1, { u } };
+		planes[2] = (struct plane){ luma + luma / 4, ctx->width / 2, 1, 1, { v } };
+		return 3;
+	default:
+		planes[0] = (struct plane){ 0, ctx->width, 2, 0, { y, y } };
+		return 1;
+	}
+}
+
+/* 'x', 'y' and the size are even */
+static void
+fill_rect(struct camera_ctx *ctx, uint8_t *data, uint32_t x, uint32_t y, uint32_t width,
+	uint32_t height, const struct yuv *colour)
+{
+	struct plane planes[PLANE_MAX];
+	unsigned int i, n = get_planes(ctx, colour, planes);
+	uint32_t row, k;
+
+	for (i = 0; i < n; i++) {
+		const struct plane *p = &planes[i];
+
+		for (row = y >> p->vshift; row < (y + height) >> p->vshift; row++) {
+			uint8_t *dst = data + p->offset + row * p->stride + (x / 2) * p->pair;
+
+			for (k = 0; k < width / 2; k++, dst += p->pair)
+				memcpy(dst, p->sample, p->pair);
+		}
+	}
+}
+
+static void
+copy_rect(struct camera_ctx *ctx, uint8_t *dst, const uint8_t *src, uint32_t x, uint32_t y,
+	uint32_t width, uint32_t height)
+{
+	struct plane planes[PLANE_MAX];
+	unsigned int i, n = get_planes(ctx, NULL, planes);
+	uint32_t row;
+	size_t offset;
+
+	for (i = 0; i < n; i++) {
+		const struct plane *p = &planes[i];
+
+		for (row = y >> p->vshift; row < (y + height) >> p->vshift; row++) {
+			offset = p->offset + row * p->stride + (x / 2) * p->pair;
+			memcpy(dst + offset, src + offset, (width / 2) * p->pair);
+		}
+	}
+}
+
+/* only the box moves, its old place is restored from the background */
+static void
+render(struct camera_ctx *ctx, unsigned int index, uint32_t sequence)
+{
+	struct pattern_camera *cam = ctx->priv;
+	uint8_t *data = cam->buffers[index];
+	uint32_t range = ctx->width - cam->box_size;
+	uint32_t x = ((uint64_t)sequence * BOX_STEP % (range ? range : 1)) & ~1U;
+
+	if (cam->box_x[index] < 0)
+		memcpy(data, cam->background, cam->frame_size);
+	else
+		copy_rect(ctx, data, cam->background, cam->box_x[index], cam->box_y, cam->box_size, cam->box_size);
+
+	fill_rect(ctx, data, x, cam->box_y, cam->box_size, cam->box_size, &box_colour);
+	cam->box_x[index] = x;
+}
@@ -0,0 +1,1059 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/videodev2.h>
+
+#include "common.h"
+#include "camera.h"
+#include "camera_backend.h"
+#include "convert.h"
+#include "format.h"
+
+/*======================================
+	Constant
+======================================*/
+
+#define FORMATS_MAX		32		/* offered by a device, more are ignored */
+#define MODES_MAX		512		/* format, size and interval combinations, likewise */
+#define FPS_TOLERANCE	0.99	/* 29.97 fps counts as 30 */
+
+#define DEFAULT_BUFFERS	4
+#define ADAPT_FRAMES	60		/* dequeues per look at the queue */
+#define ADAPT_CALM		5		/* looks without a loss before a buffer is given up */
+#define SAMPLE_PERIOD	32		/* dequeues per queue sample when not adapting */
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct buffer {
+	void   *start;
+	size_t	length;
+	bool	held;		/* dequeued and handed out */
+};
+
+struct v4l2_camera {
+	const char	   *dev_name;
+	int				fd;
+	struct buffer  *buffers;
+	unsigned int	held_nr;
+	struct v4l2_fract	interval;	/* negotiated, 0/0 : left to the driver */
+
+	unsigned int	count;		/* buffers to request */
+	unsigned int	count_min, count_max;	/* adaptive when they differ */
+	unsigned int	resize_to;	/* restream once nothing is held, 0 : no */
+
+	bool			sequenced;	/* 'sequence' is of this stream */
+	uint32_t		sequence;	/* of the last dequeued frame */
+	struct camera_queue_stats	stats;
+
+	/* since the last look at the queue */
+	unsigned int	window_frames;
+	uint64_t		window_lost;
+	unsigned int	window_queued_min;
+	unsigned int	calm;		/* looks in a row without a loss */
+};
+
+/* one way the device can capture */
+struct mode {
+	uint32_t			format;
+	unsigned int		rank;		/* in the caller's formats, lower is preferred */
+	uint32_t			width, height;
+	struct v4l2_fract	interval;	/* [s], 0/0 : unknown */
+};
+
+struct mode_list {
+	struct mode		modes[MODES_MAX];
+	unsigned int	nr;
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static bool v4l2_open(struct camera_ctx *ctx, const struct camera_config *config,
+	const uint32_t *formats, unsigned int formats_nr);
+static void v4l2_close(struct camera_ctx *ctx);
+static bool v4l2_start(struct camera_ctx *ctx);
+static bool v4l2_stop(struct camera_ctx *ctx);
+static int v4l2_acquire(struct camera_ctx *ctx, struct camera_frame *frame);
+static bool v4l2_release(struct camera_ctx *ctx, struct camera_frame *frame);
+static int v4l2_get_fd(struct camera_ctx *ctx);
+static bool v4l2_get_stats(struct camera_ctx *ctx, struct camera_queue_stats *stats);
+
+static bool open_device(struct camera_ctx *ctx);
+static void close_device(struct camera_ctx *ctx);
+
+static bool init_device(struct camera_ctx *ctx);
+static void terminate_device(struct camera_ctx *ctx);
+
+static bool init_mmap(struct camera_ctx *ctx);
+static bool stream_on(struct camera_ctx *ctx);
+static bool resize_queue(struct camera_ctx *ctx);
+static void sample_queue(struct camera_ctx *ctx, const struct camera_frame *frame);
+static void adapt_queue(struct camera_ctx *ctx);
+
+static int dequeue_buffer(struct camera_ctx *ctx, struct v4l2_buffer *buf);
+static bool queue_buffer(struct camera_ctx *ctx, unsigned int index);
+static void hold_buffer(struct camera_ctx *ctx, struct v4l2_buffer *buf, struct camera_frame *frame);
+
+static bool set_frame_interval(struct camera_ctx *ctx);
+
+static bool negotiate_mode(struct camera_ctx *ctx, const struct camera_config *config,
+	const uint32_t *formats, unsigned int formats_nr);
+static void enum_sizes(struct camera_ctx *ctx, const struct camera_config *config,
+	struct mode_list *list, uint32_t format, unsigned int rank);
+static void enum_intervals(struct camera_ctx *ctx, const struct camera_config *config,
+	struct mode_list *list, const struct mode *mode);
+static void add_mode(struct mode_list *list, const struct mode *mode);
+static double mode_fps(const struct mode *mode);
+static bool is_better_mode(const struct mode *a, const struct mode *b, const struct camera_config *config);
+static unsigned int mode_meets(const struct mode *mode, const struct camera_config *config);
+static enum convert_matrix get_matrix(const struct v4l2_pix_format *pix);
+
+static int xioctl(int fd, int request, void *arg);
+
+
+/*======================================
+	Variable
+======================================*/
+
+/* tried within stepwise and continuous size ranges, besides the bounds */
+static const struct {
+	uint32_t width, height;
+} common_sizes[] = {
+	{  320,  240 }, {  640,  480 }, {  800,  600 }, { 1024,  768 },
+	{ 1280,  720 }, { 1280,  960 }, { 1600, 1200 }, { 1920, 1080 },
+	{ 2560, 1440 }, { 3840, 2160 },
+};
+
+const struct camera_backend camera_v4l2_backend = {
+	.name		= "v4l2",
+	.open		= v4l2_open,
+	.close		= v4l2_close,
+	.start		= v4l2_start,
+	.stop		= v4l2_stop,
+	.acquire	= v4l2_acquire,
+	.release	= v4l2_release,
+	.get_fd		= v4l2_get_fd,
+	.get_stats	= v4l2_get_stats,
+};
+
+
+/*======================================
+	Inner function
+======================================*/
+
+/*
+ * 'formats' lists the pixel formats the caller can handle, most preferred
+ * first; the first one the device offers is negotiated.
+ */
+static bool
+v4l2_open(struct camera_ctx *ctx, const struct camera_config *config,
+	const uint32_t *formats, unsigned int formats_nr)
+{
+	struct v4l2_camera *cam;
+
+	cam = (struct v4l2_camera *)calloc(1, sizeof(struct v4l2_camera));
+	if (!cam) {
+		LOG_ERROR("Out of Memory");
+		return false;
+	}
+
+	cam->dev_name = config->name;
+	cam->fd = -1;
+	cam->count_min = config->buffers ? config->buffers : DEFAULT_BUFFERS;
+	cam->count_max = config->buffers_max > cam->count_min ? config->buffers_max : cam->count_min;
+	cam->count = cam->count_min;
+	ctx->priv = cam;
+
+	if (!open_device(ctx))
+		goto err;
+
+	if (!negotiate_mode(ctx, config, formats, formats_nr)) {
+		close_device(ctx);
+		goto err;
+	}
+
+	if (!init_device(ctx)) {
+		terminate_device(ctx);
+		close_device(ctx);
+		goto err;
+	}
+
+	return true;
+
+err:
+	free(cam);
+	ctx->priv = NULL;
+	return false;
+}
+
+static void
+v4l2_close(struct camera_ctx *ctx)
+{
+	terminate_device(ctx);
+	close_device(ctx);
+	free(ctx->priv);
+	ctx->priv = NULL;
+}
+
+static bool
+v4l2_start(struct camera_ctx *ctx)
+{
+	unsigned int i;
+
+	if (!stream_on(ctx))
+		return false;
+
+	/* empty reading */
+	for (i = 0; i < 5; i++) {
+		struct camera_frame frame;
+
+		if (camera_acquire_frame(ctx, &frame))
+			camera_release_frame(ctx, &frame);
+	}
+
+	return true;
+}
+
+static bool
+v4l2_stop(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	unsigned int i;
+	enum v4l2_buf_type type;
+
+	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (xioctl(cam->fd, VIDIOC_STREAMOFF, &type) < 0) {
+		LOG_PERROR("VIDIOC_STREAMOFF");
+		return false;
+	}
+
+	/* STREAMOFF takes every buffer back, held or not */
+	for (i = 0; i < ctx->buffers_nr; i++)
+		cam->buffers[i].held = false;
+	cam->held_nr = 0;
+
+	return true;
+}
+
+static int
+v4l2_acquire(struct camera_ctx *ctx, struct camera_frame *frame)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct v4l2_buffer buf;
+	int status;
+
+	if (cam->held_nr >= ctx->buffers_nr) {
+		LOG_ERROR("all %u buffers are held", ctx->buffers_nr);
+		return -1;
+	}
+
+	status = dequeue_buffer(ctx, &buf);
+	if (status > 0) {
+		hold_buffer(ctx, &buf, frame);
+		sample_queue(ctx, frame);
+		adapt_queue(ctx);
+	}
+
+	return status;
+}
+
+static bool
+v4l2_release(struct camera_ctx *ctx, struct camera_frame *frame)
+{
+	struct v4l2_camera *cam = ctx->priv;
+
+	if (frame->index >= ctx->buffers_nr || !cam->buffers[frame->index].held) {
+		LOG_ERROR("buffer %u is not held", frame->index);
+		return false;
+	}
+
+	if (!queue_buffer(ctx, frame->index))
+		return false;
+
+	cam->buffers[frame->index].held = false;
+	cam->held_nr--;
+
+	/* the buffers go away, none may be held */
+	if (cam->resize_to && !cam->held_nr)
+		return resize_queue(ctx);
+
+	return true;
+}
+
+/* polls readable once a frame can be dequeued */
+static int
+v4l2_get_fd(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+
+	return cam->fd;
+}
+
+static bool
+v4l2_get_stats(struct camera_ctx *ctx, struct camera_queue_stats *stats)
+{
+	struct v4l2_camera *cam = ctx->priv;
+
+	*stats = cam->stats;
+	stats->depth = ctx->buffers_nr;
+
+	return true;
+}
+
+static bool
+open_device(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct stat st;
+
+	if (stat(cam->dev_name, &st) == -1) {
+		LOG_ERROR("Cannot identify '%s' : %d, %s", cam->dev_name, errno, strerror(errno));
+		return false;
+	}
+
+	if (!S_ISCHR(st.st_mode)) {
+		LOG_ERROR("%s is no device", cam->dev_name);
+		return false;
+	}
+
+	cam->fd = open(cam->dev_name, O_RDWR | O_NONBLOCK, 0);
+
+	if (cam->fd < 0) {
+		LOG_ERROR("Cannot open '%s': %d, %s", cam->dev_name, errno, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static void
+close_device(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+
+	close(cam->fd);
+}
+
+static bool
+init_device(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct v4l2_capability cap;
+	struct v4l2_cropcap cropcap;
+	struct v4l2_format fmt;
+
+	if (xioctl(cam->fd, VIDIOC_QUERYCAP, &cap) < 0) {
+		if (errno == EINVAL)
+			LOG_ERROR("%s is no V4L2 device", cam->dev_name);
+		else
+			LOG_PERROR("VIDIOC_QUERYCAP");
+
+		return false;
+	}
+
+	if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
+		LOG_ERROR("%s is no video capture device", cam->dev_name);
+		return false;
+	}
+
+	if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
+		LOG_ERROR("%s does not support streaming I/O", cam->dev_name);
+		return false;
+	}
+
+	memset(&cropcap, 0, sizeof(cropcap));
+	cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (xioctl(cam->fd, VIDIOC_CROPCAP, &cropcap) == 0) {
+		struct v4l2_crop crop;
+		crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		crop.c = cropcap.defrect; /* reset to default */
+
+		xioctl(cam->fd, VIDIOC_S_CROP, &crop);
+	}
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type				= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.fmt.pix.width		= camera_get_width(ctx);
+	fmt.fmt.pix.height		= camera_get_height(ctx);
+	fmt.fmt.pix.pixelformat	= ctx->format;
+	if (xioctl(cam->fd, VIDIOC_S_FMT, &fmt) < 0) {
+		LOG_PERROR("VIDIOC_S_FMT");
+		return false;
+	}
+
+	if (fmt.fmt.pix.pixelformat != ctx->format) {
+		LOG_ERROR("%s refused %s", cam->dev_name, format_get_name(ctx->format));
+		return false;
+	}
+
+	ctx->width	= fmt.fmt.pix.width;
+	ctx->height	= fmt.fmt.pix.height;
+	ctx->matrix	= get_matrix(&fmt.fmt.pix);
+
+	if (!set_frame_interval(ctx))
+		return false;
+
+	/* the converters expect packed planes, compressed frames have no stride */
+	if (fmt.fmt.pix.bytesperline && format_get_stride(ctx->format, ctx->width)
+		&& fmt.fmt.pix.bytesperline != format_get_stride(ctx->format, ctx->width)) {
+		LOG_ERROR("Padded lines are not supported (bytesperline %u, width %u)",
+				fmt.fmt.pix.bytesperline, ctx->width);
+		return false;
+	}
+
+	return init_mmap(ctx);
+}
+
+static void
+terminate_device(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	int i;
+
+	for (i = 0; i < ctx->buffers_nr; i++)
+		if (munmap(cam->buffers[i].start, cam->buffers[i].length) < 0)
+			LOG_PERROR("munmap");
+
+	free(cam->buffers);
+	cam->buffers = NULL;
+	ctx->buffers_nr = 0;
+}
+
+static bool
+init_mmap(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct v4l2_requestbuffers req;
+
+	memset(&req, 0, sizeof(req));
+	req.count = cam->count;
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_MMAP;
+	if (xioctl(cam->fd, VIDIOC_REQBUFS, &req) < 0) {
+		if (errno == EINVAL)
+			LOG_ERROR("%s does not support memory mapping", cam->dev_name);
+		else
+			LOG_PERROR("VIDIOC_REQBUFS");
+
+		return false;
+	}
+
+	if (req.count < 2) {
+		LOG_ERROR("Insufficient buffer memory on %s", cam->dev_name);
+		return false;
+	}
+
+	cam->buffers = calloc(req.count, sizeof(struct buffer));
+	if (!cam->buffers) {
+		LOG_ERROR("Out of memory");
+		return false;
+	}
+
+	for (ctx->buffers_nr = 0; ctx->buffers_nr < req.count; ctx->buffers_nr++) {
+		struct v4l2_buffer buf;
+
+		memset(&buf, 0, sizeof(buf));
+		buf.type	= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory	= V4L2_MEMORY_MMAP;
+		buf.index	= ctx->buffers_nr;
+		if (xioctl(cam->fd, VIDIOC_QUERYBUF, &buf) < 0) {
+			LOG_PERROR("VIDIOC_QUERYBUF");
+			return false;
+		}
+
+		cam->buffers[ctx->buffers_nr].length = buf.length;
+		cam->buffers[ctx->buffers_nr].start =
+			mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, cam->fd, buf.m.offset);
+		if (cam->buffers[ctx->buffers_nr].start == MAP_FAILED) {
+			LOG_PERROR("mmap");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* every buffer to the driver, a new stream starts its sequence over */
+static bool
+stream_on(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	unsigned int i;
+	enum v4l2_buf_type type;
+
+	for (i = 0; i < ctx->buffers_nr; i++)
+		if (!queue_buffer(ctx, i))
+			return false;
+
+	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (xioctl(cam->fd, VIDIOC_STREAMON, &type) < 0) {
+		LOG_PERROR("VIDIOC_STREAMON");
+		return false;
+	}
+
+	cam->sequenced			= false;
+	cam->window_frames		= 0;
+	cam->window_lost		= 0;
+	cam->window_queued_min	= UINT_MAX;
+
+	return true;
+}
+
+/*
+ * Restream with 'resize_to' buffers, the frames in the queue are lost. A
+ * driver settling on another count bounds the adaptation there.
+ */
+static bool
+resize_queue(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	unsigned int old = ctx->buffers_nr;
+
+	cam->count = cam->resize_to;
+	cam->resize_to = 0;
+
+	if (!v4l2_stop(ctx))
+		return false;
+
+	terminate_device(ctx);
+
+	if (!init_mmap(ctx) || !stream_on(ctx))
+		return false;
+
+	if (cam->count > old && ctx->buffers_nr <= old)
+		cam->count_max = ctx->buffers_nr;
+	else if (cam->count < old && ctx->buffers_nr >= old)
+		cam->count_min = ctx->buffers_nr;
+
+	cam->stats.resizes++;
+
+	return true;
+}
+
+/*
+ * Right after 'frame' was dequeued : the frames the driver skipped before
+ * it, and how many buffers it has left to fill and filled for us. That
+ * takes a QUERYBUF per buffer, so it is looked at on every dequeue only
+ * while the depth adapts, otherwise every SAMPLE_PERIOD for the stats.
+ */
+static void
+sample_queue(struct camera_ctx *ctx, const struct camera_frame *frame)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct camera_queue_stats *stats = &cam->stats;
+	struct v4l2_buffer query;
+	unsigned int i, queued = 0, done = 0;
+
+	stats->frames++;
+	cam->window_frames++;
+	cam->window_lost += frame->lost;
+
+	if (cam->count_min == cam->count_max && (stats->frames - 1) % SAMPLE_PERIOD)
+		return;
+
+	for (i = 0; i < ctx->buffers_nr; i++) {
+		if (cam->buffers[i].held)
+			continue;
+
+		memset(&query, 0, sizeof(query));
+		query.type		= V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		query.memory	= V4L2_MEMORY_MMAP;
+		query.index		= i;
+		if (xioctl(cam->fd, VIDIOC_QUERYBUF, &query) < 0)
+			continue;
+
+		if (query.flags & V4L2_BUF_FLAG_DONE)
+			done++;
+		else if (query.flags & V4L2_BUF_FLAG_QUEUED)
+			queued++;
+	}
+
+	if (!stats->samples || queued < stats->queued_min)
+		stats->queued_min = queued;
+	if (done > stats->done_max)
+		stats->done_max = done;
+
+	stats->samples++;
+	stats->queued_sum	+= queued;
+	stats->done_sum		+= done;
+
+	if (queued < cam->window_queued_min)
+		cam->window_queued_min = queued;
+}
+
+/*
+ * Every ADAPT_FRAMES dequeues, between the configured bounds : a frame the
+ * driver lost takes one more buffer. ADAPT_CALM looks in a row without a
+ * loss, while the driver always had two buffers left, give one up.
+ */
+static void
+adapt_queue(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+
+	if (cam->count_min == cam->count_max || cam->window_frames < ADAPT_FRAMES)
+		return;
+
+	if (cam->window_lost) {
+		cam->calm = 0;
+		if (ctx->buffers_nr < cam->count_max)
+			cam->resize_to = ctx->buffers_nr + 1;
+	} else if (++cam->calm >= ADAPT_CALM && cam->window_queued_min >= 2
+		&& ctx->buffers_nr > cam->count_min) {
+		cam->calm = 0;
+		cam->resize_to = ctx->buffers_nr - 1;
+	}
+
+	cam->window_frames		= 0;
+	cam->window_lost		= 0;
+	cam->window_queued_min	= UINT_MAX;
+}
+
+static int
+dequeue_buffer(struct camera_ctx *ctx, struct v4l2_buffer *buf)
+{
+	struct v4l2_camera *cam = ctx->priv;
+
+	memset(buf, 0, sizeof(*buf));
+	buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf->memory = V4L2_MEMORY_MMAP;
+	if (xioctl(cam->fd, VIDIOC_DQBUF, buf) < 0) {
+		if (errno == EAGAIN) {
+			return 0;
+		} else {
+			LOG_PERROR("VIDIOC_DQBUF");
+			return -1;
+		}
+	}
+
+	if (buf->index >= ctx->buffers_nr) {
+		LOG_ERROR("buf.index(%u) >= buffers_nr(%u)", buf->index, ctx->buffers_nr);
+		return -1;
+	}
+
+	return 1;
+}
+
+static bool
+queue_buffer(struct camera_ctx *ctx, unsigned int index)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct v4l2_buffer buf;
+
+	if (index >= ctx->buffers_nr) {
+		LOG_ERROR("index(%u) >= buffers_nr(%u)", index, ctx->buffers_nr);
+		return false;
+	}
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = index;
+	if (xioctl(cam->fd, VIDIOC_QBUF, &buf) < 0) {
+		LOG_PERROR("VIDIOC_QBUF");
+		return false;
+	}
+
+	return true;
+}
+
+static void
+hold_buffer(struct camera_ctx *ctx, struct v4l2_buffer *buf, struct camera_frame *frame)
+{
+	struct v4l2_camera *cam = ctx->priv;
+
+	cam->buffers[buf->index].held = true;
+	cam->held_nr++;
+
+	frame->data			= cam->buffers[buf->index].start;
+	frame->bytesused	= buf->bytesused;
+	frame->index		= buf->index;
+	frame->sequence		= buf->sequence;
+	frame->lost			= 0;
+	frame->timestamp	= (uint64_t)buf->timestamp.tv_sec * 1000000000ULL
+						+ (uint64_t)buf->timestamp.tv_usec * 1000ULL;
+	frame->error		= buf->flags & V4L2_BUF_FLAG_ERROR;
+
+	/* the sequence gap, a driver not counting repeats its sequence, that is no gap */
+	if (cam->sequenced && buf->sequence - cam->sequence - 1 < 0x80000000U)
+		frame->lost = buf->sequence - cam->sequence - 1;
+
+	cam->sequence = buf->sequence;
+	cam->sequenced = true;
+}
+
+/*
+ * The rate of the negotiated mode, where the driver lets it be set. What
+ * the driver made of it is the nominal rate.
+ */
+static bool
+set_frame_interval(struct camera_ctx *ctx)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct v4l2_streamparm parm;
+	struct v4l2_fract *tpf = &parm.parm.capture.timeperframe;
+
+	ctx->fps = 0;
+
+	memset(&parm, 0, sizeof(parm));
+	parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (xioctl(cam->fd, VIDIOC_G_PARM, &parm) < 0)
+		return true;	/* not every driver knows about rates */
+
+	if (cam->interval.numerator && (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+		*tpf = cam->interval;
+		if (xioctl(cam->fd, VIDIOC_S_PARM, &parm) < 0) {
+			LOG_PERROR("VIDIOC_S_PARM");
+			return false;
+		}
+	}
+
+	if (tpf->numerator)
+		ctx->fps = (double)tpf->denominator / tpf->numerator;
+
+	return true;
+}
+
+/*
+ * Every format, size and interval the device offers in a format the caller
+ * can handle. The best for the configuration wins : the most minimums met,
+ * then the preferred of rate and size, then the other, then the order of
+ * 'formats'. Without any target the order of 'formats' comes first.
+ */
+static bool
+negotiate_mode(struct camera_ctx *ctx, const struct camera_config *config,
+	const uint32_t *formats, unsigned int formats_nr)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct v4l2_fmtdesc desc;
+	struct mode_list *list;
+	const struct mode *best = NULL;
+	unsigned int wanted, i;
+
+	list = (struct mode_list *)calloc(1, sizeof(struct mode_list));
+	if (!list) {
+		LOG_ERROR("Out of Memory");
+		return false;
+	}
+
+	memset(&desc, 0, sizeof(desc));
+	desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	for (desc.index = 0; desc.index < FORMATS_MAX && xioctl(cam->fd, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++) {
+		for (i = 0; i < formats_nr; i++)
+			if (formats[i] == desc.pixelformat && (!config->format || formats[i] == config->format))
+				break;
+
+		if (i < formats_nr)
+			enum_sizes(ctx, config, list, desc.pixelformat, i);
+	}
+
+	for (i = 0; i < list->nr; i++)
+		if (!best || is_better_mode(&list->modes[i], best, config))
+			best = &list->modes[i];
+
+	if (!best) {
+		if (config->format)
+			LOG_ERROR("%s cannot capture %s, or it cannot be converted", cam->dev_name,
+					format_get_name(config->format));
+		else
+			LOG_ERROR("%s offers no supported pixel format", cam->dev_name);
+
+		free(list);
+		return false;
+	}
+
+	wanted = (config->width || config->height) + (config->fps > 0);
+	if (mode_meets(best, config) < wanted)
+		LOG_ERROR("%s offers no mode of %ux%u at %d fps or more, the closest is %ux%u at %.2f fps",
+				cam->dev_name, config->width, config->height, config->fps > 0 ? config->fps : 0,
+				best->width, best->height, mode_fps(best));
+
+	ctx->format		= best->format;
+	ctx->width		= best->width;
+	ctx->height		= best->height;
+	cam->interval	= best->interval;
+
+	free(list);
+
+	return true;
+}
+
+/*
+ * Discrete sizes as listed. Of a stepwise or continuous range its bounds,
+ * the configured size and the common sizes, rounded up onto its steps.
+ */
+static void
+enum_sizes(struct camera_ctx *ctx, const struct camera_config *config,
+	struct mode_list *list, uint32_t format, unsigned int rank)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct v4l2_frmsizeenum size;
+	struct v4l2_frmsize_stepwise *range = &size.stepwise;
+	struct mode mode = { .format = format, .rank = rank };
+	uint32_t step_width, step_height;
+	unsigned int i, sizes_nr = sizeof(common_sizes) / sizeof(common_sizes[0]);
+
+	memset(&size, 0, sizeof(size));
+	size.pixel_format = format;
+
+	/* no list, S_FMT takes the configured or current size or the nearest */
+	if (xioctl(cam->fd, VIDIOC_ENUM_FRAMESIZES, &size) < 0) {
+		struct v4l2_format fmt;
+
+		memset(&fmt, 0, sizeof(fmt));
+		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (!config->width && xioctl(cam->fd, VIDIOC_G_FMT, &fmt) == 0) {
+			mode.width	= fmt.fmt.pix.width;
+			mode.height	= fmt.fmt.pix.height;
+		} else {
+			mode.width	= config->width;
+			mode.height	= config->height;
+		}
+
+		enum_intervals(ctx, config, list, &mode);
+		return;
+	}
+
+	if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+		do {
+			mode.width	= size.discrete.width;
+			mode.height	= size.discrete.height;
+			enum_intervals(ctx, config, list, &mode);
+
+			size.index++;
+		} while (xioctl(cam->fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0
+			&& size.type == V4L2_FRMSIZE_TYPE_DISCRETE);
+
+		return;
+	}
+
+	step_width	= size.type == V4L2_FRMSIZE_TYPE_STEPWISE && range->step_width ? range->step_width : 1;
+	step_height	= size.type == V4L2_FRMSIZE_TYPE_STEPWISE && range->step_height ? range->step_height : 1;
+
+	for (i = 0; i < sizes_nr + 3; i++) {
+		uint32_t width, height;
+
+		if (i == 0) {
+			width	= range->max_width;
+			height	= range->max_height;
+		} else if (i == 1) {
+			width	= range->min_width;
+			height	= range->min_height;
+		} else if (i == 2) {
+			if (!config->width || !config->height)
+				continue;
+			width	= config->width;
+			height	= config->height;
+		} else {
+			width	= common_sizes[i - 3].width;
+			height	= common_sizes[i - 3].height;
+		}
+
+		if (width < range->min_width)
+			width = range->min_width;
+		if (height < range->min_height)
+			height = range->min_height;
+
+		width	= range->min_width + (width - range->min_width + step_width - 1) / step_width * step_width;
+		height	= range->min_height + (height - range->min_height + step_height - 1) / step_height * step_height;
+
+		if (width > range->max_width || height > range->max_height)
+			continue;
+
+		mode.width	= width;
+		mode.height	= height;
+		enum_intervals(ctx, config, list, &mode);
+	}
+}
+
+/*
+ * Discrete intervals as listed, of a range only its fastest end : a slower
+ * rate of the same size never wins.
+ */
+static void
+enum_intervals(struct camera_ctx *ctx, const struct camera_config *config,
+	struct mode_list *list, const struct mode *mode)
+{
+	struct v4l2_camera *cam = ctx->priv;
+	struct v4l2_frmivalenum ival;
+	struct mode with = *mode;
+
+	memset(&ival, 0, sizeof(ival));
+	ival.pixel_format	= mode->format;
+	ival.width			= mode->width;
+	ival.height			= mode->height;
+
+	/* no list, the driver keeps its rate */
+	if (xioctl(cam->fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) < 0) {
+		with.interval.numerator		= 0;
+		with.interval.denominator	= 0;
+		add_mode(list, &with);
+		return;
+	}
+
+	if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+		with.interval = ival.stepwise.min;
+		add_mode(list, &with);
+		return;
+	}
+
+	do {
+		with.interval = ival.discrete;
+		add_mode(list, &with);
+
+		ival.index++;
+	} while (xioctl(cam->fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) == 0
+		&& ival.type == V4L2_FRMIVAL_TYPE_DISCRETE);
+}
+
+static void
+add_mode(struct mode_list *list, const struct mode *mode)
+{
+	if (list->nr < MODES_MAX)
+		list->modes[list->nr++] = *mode;
+}
+
+/* 0 : unknown */
+static double
+mode_fps(const struct mode *mode)
+{
+	if (!mode->interval.numerator)
+		return 0;
+
+	return (double)mode->interval.denominator / mode->interval.numerator;
+}
+
+/* true when 'a' suits the configuration better than 'b' */
+static bool
+is_better_mode(const struct mode *a, const struct mode *b, const struct camera_config *config)
+{
+	uint64_t pixels_a = (uint64_t)a->width * a->height;
+	uint64_t pixels_b = (uint64_t)b->width * b->height;
+	double fps_a = mode_fps(a), fps_b = mode_fps(b);
+	unsigned int met_a = mode_meets(a, config), met_b = mode_meets(b, config);
+	bool targeted = config->width || config->height || config->fps >= 0
+		|| config->prefer != CAMERA_PREFER_DEFAULT;
+
+	if (met_a != met_b)
+		return met_a > met_b;
+
+	if (!targeted && a->rank != b->rank)
+		return a->rank < b->rank;
+
+	if (config->prefer != CAMERA_PREFER_SIZE && fps_a != fps_b)
+		return fps_a > fps_b;
+
+	if (pixels_a != pixels_b)
+		return pixels_a > pixels_b;
+
+	if (fps_a != fps_b)
+		return fps_a > fps_b;
+
+	return a->rank < b->rank;
+}
+
+/* how many of the configured minimums the mode reaches */
+static unsigned int
+mode_meets(const struct mode *mode, const struct camera_config *config)
+{
+	unsigned int met = 0;
+
+	if ((config->width || config->height)
+		&& mode->width >= config->width && mode->height >= config->height)
+		met++;
+
+	if (config->fps > 0 && mode_fps(mode) >= config->fps * FPS_TOLERANCE)
+		met++;
+
+	return met;
+}
+
+/*
+ * Encoding and quantization may be left to their defaults, which follow from
+ * the colorspace. BT.2020 and SMPTE 240M are closest to the BT.709 matrix.
+ */
+static enum convert_matrix
+get_matrix(const struct v4l2_pix_format *pix)
+{
+	uint32_t ycbcr_enc = V4L2_YCBCR_ENC_DEFAULT;
+	uint32_t quantization = V4L2_QUANTIZATION_DEFAULT;
+	bool bt601, full;
+
+	/* the extended fields are only valid with the magic */
+	if (pix->priv == V4L2_PIX_FMT_PRIV_MAGIC) {
+		ycbcr_enc		= pix->ycbcr_enc;
+		quantization	= pix->quantization;
+	}
+
+	if (ycbcr_enc == V4L2_YCBCR_ENC_DEFAULT)
+		ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(pix->colorspace);
+
+	if (quantization == V4L2_QUANTIZATION_DEFAULT)
+		quantization = V4L2_MAP_QUANTIZATION_DEFAULT(false, pix->colorspace, ycbcr_enc);
+
+	bt601	= ycbcr_enc == V4L2_YCBCR_ENC_601 || ycbcr_enc == V4L2_YCBCR_ENC_XV601;
+	full	= quantization == V4L2_QUANTIZATION_FULL_RANGE;
+
+	if (bt601)
+		return full ? CONVERT_MATRIX_BT601_FULL : CONVERT_MATRIX_BT601_LIMITED;
+	else
+		return full ? CONVERT_MATRIX_BT709_FULL : CONVERT_MATRIX_BT709_LIMITED;
+}
+
+static int
+xioctl(int fh, int request, void *arg)
+{
+	int r;
+
+	do {
+		r = ioctl(fh, request, arg);
+	} while ((r < 0) && (errno == EINTR));
+
+	return r;
+}
+
@@ -29,6 +29,7 @@
 ======================================*/
 
 #include <stdio.h>
+#include <stdint.h>
 #include <errno.h>
 
 
@@ -41,4 +42,25 @@
 
 #define LOG_PERROR(str) LOG_ERROR("%s error %d, %s", str, errno, strerror(errno))
 
+#define FOURCC(a, b, c, d)	((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+
+/*======================================
+	Constant
+======================================*/
+
+/*
+ * Pixel formats are DRM fourcc codes, which V4L2 and wl_shm share for YUV.
+ * GREY is V4L2 only (DRM calls it R8), so it never passes through.
+ */
+#define FORMAT_ARGB8888		FOURCC('A', 'R', '2', '4')
+#define FORMAT_XRGB8888		FOURCC('X', 'R', '2', '4')
+#define FORMAT_YUYV			FOURCC('Y', 'U', 'Y', 'V')
+#define FORMAT_UYVY			FOURCC('U', 'Y', 'V', 'Y')
+#define FORMAT_NV12			FOURCC('N', 'V', '1', '2')
+#define FORMAT_NV21			FOURCC('N', 'V', '2', '1')
+#define FORMAT_YUV420		FOURCC('Y', 'U', '1', '2')	/* I420 */
+#define FORMAT_GREY			FOURCC('G', 'R', 'E', 'Y')
+#define FORMAT_MJPEG		FOURCC('M', 'J', 'P', 'G')	/* V4L2 only, decoded by mjpeg.c */
+
 #endif /* _COMMON_H */
@@ -31,8 +31,15 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERT_X86
+#include <immintrin.h>
+#endif /* __x86_64__ || __i386__ */
+
 #include "common.h"
 #include "convert.h"
+#include "format.h"
+#include "worker.h"
 
 
 /*======================================
@@ -44,11 +51,398 @@
 	else if (val > max) val = max;	\
 } while(0)
 
+#define CLAMP_U8(val)	((val) < 0 ? 0 : ((val) > 255 ? 255 : (val)))
+
+/* (U, V) coefficient pair as seen by pmaddwd on interleaved U/V words */
+#define COEF_PAIR(cu, cv)	((int)(((uint32_t)(uint16_t)(cv) << 16) | (uint16_t)(cu)))
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+/*
+ * Kernels are written once as always-inlined templates taking a colour
+ * matrix, and instantiated below for every matrix with a constant one : the
+ * compiler folds the coefficients and drops the range and rounding steps a
+ * matrix does not need, so no kernel branches on the matrix at run time.
+ */
+#define TEMPLATE	static inline __attribute__((always_inline))
+
+/*
+ * The portable kernel is written with the vector extensions of gcc and clang,
+ * which lower to SSE2 or NEON, or to scalar code on targets without either.
+ * The lanes hold whole YUYV macropixels, which is only the byte order above
+ * on little endian.
+ */
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CONVERT_VECTOR
+
+typedef uint32_t	v4su __attribute__((vector_size(16)));
+typedef int32_t		v4si __attribute__((vector_size(16)));
+
+#ifdef __clang__
+#define ZIP_LO(a, b)	__builtin_shufflevector(a, b, 0, 4, 1, 5)
+#define ZIP_HI(a, b)	__builtin_shufflevector(a, b, 2, 6, 3, 7)
+#else
+#define ZIP_LO(a, b)	__builtin_shuffle(a, b, (v4su){ 0, 4, 1, 5 })
+#define ZIP_HI(a, b)	__builtin_shuffle(a, b, (v4su){ 2, 6, 3, 7 })
+#endif /* __clang__ */
+#endif /* __GNUC__ && little endian */
+
+#define FOR_EACH_MATRIX(X)								\
+	X(legacy,			CONVERT_MATRIX_LEGACY)			\
+	X(bt601_limited,	CONVERT_MATRIX_BT601_LIMITED)	\
+	X(bt601_full,		CONVERT_MATRIX_BT601_FULL)		\
+	X(bt709_limited,	CONVERT_MATRIX_BT709_LIMITED)	\
+	X(bt709_full,		CONVERT_MATRIX_BT709_FULL)
+
+/* { [matrix] = entry(name), ... } */
+#define MATRIX_TABLE(entry) {										\
+	[CONVERT_MATRIX_LEGACY]			= entry(legacy),				\
+	[CONVERT_MATRIX_BT601_LIMITED]	= entry(bt601_limited),			\
+	[CONVERT_MATRIX_BT601_FULL]		= entry(bt601_full),			\
+	[CONVERT_MATRIX_BT709_LIMITED]	= entry(bt709_limited),			\
+	[CONVERT_MATRIX_BT709_FULL]		= entry(bt709_full),			\
+}
+
+
+/*======================================
+	Constant
+======================================*/
+
+/* Coefficients of convert_yuyv_to_bgrx8888(), the legacy matrix */
+#define COEF_RV		359
+#define COEF_GU		88
+#define COEF_GV		183
+#define COEF_BU		454
+
+
+/*======================================
+	Structure
+======================================*/
+
+/*
+ * Y' = (Y - y_offset) * (256 + y_gain) / 256
+ * R  = Y' + rv * (V - 128) / 256
+ * G  = Y' - (gu * (U - 128) + gv * (V - 128)) / 256
+ * B  = Y' + bu * (U - 128) / 256
+ *
+ * Divisions are '+ round >> 8', the legacy matrix truncates like the
+ * reference. Limited range folds the 255/219 and 255/224 expansions into the
+ * gain and the chroma coefficients.
+ */
+struct colour_matrix {
+	const char *name;
+	int			y_offset;
+	int			y_gain;
+	int			rv, gu, gv, bu;
+	int			round;
+};
+
+/* Converts 'pairs' YUYV macropixels (2 pixels each) to BGRX8888 */
+typedef void (*yuyv_span_func)(uint8_t *dst, const uint8_t *src, size_t pairs);
+
+struct impl_desc {
+	const char	   *name;
+	bool			(*is_supported)(void);
+};
+
+/*
+ * Where the samples of a packed frame are, as byte offsets from its start.
+ * Chroma is always subsampled by 2 horizontally, c_vshift is 1 for 4:2:0.
+ */
+struct frame_layout {
+	size_t			y, u, v;
+	size_t			y_stride, c_stride;
+	unsigned int	y_step, c_step;		/* bytes between two samples of a row */
+	unsigned int	c_vshift;
+	bool			chroma;				/* false : GREY, U = V = 128 */
+};
+
+struct band_job;
+
+/* Converts destination rows [first, last) of a job */
+typedef void (*band_func)(const struct band_job *job, uint32_t first, uint32_t last);
+
+/* Converts one row of 'width' pixels to BGRX8888 at 'dst' */
+typedef void (*row_func)(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t width);
+
+/* Scales and converts destination rows [first, last) to BGRX8888 */
+typedef void (*scale_func)(const struct convert_scaler *scaler, uint8_t *dst, const uint8_t *src,
+	uint32_t first, uint32_t last);
+
+struct converter {
+	uint32_t		src_format;
+	uint32_t		dst_format;
+	unsigned int	cost;		/* per pixel, the cheapest source is negotiated */
+	band_func		band;
+
+	/* NULL : next lower implementation */
+	row_func		row[CONVERT_MATRIX_NR][CONVERT_IMPL_NR];
+};
+
+/* horizontal bilinear tap, weights are 8bit fractions of the second sample */
+struct bilinear_tap {
+	uint32_t	y0, y1;		/* luma columns */
+	uint32_t	c0, c1;		/* chroma columns */
+	uint16_t	yf, cf;
+};
+
+struct convert_scaler {
+	uint32_t				format;
+	struct frame_layout		layout;
+	enum convert_scale		mode;
+	uint32_t				src_width, src_height;
+	uint32_t				dst_width, dst_height;
+
+	uint32_t			   *box_x;		/* box : dst_width + 1 column edges */
+	struct bilinear_tap	   *taps;		/* bilinear : dst_width taps */
+};
+
+struct band_job {
+	const struct converter *conv;		/* NULL : scaler */
+	enum convert_impl		impl;
+	enum convert_matrix		matrix;
+	struct frame_layout		layout;
+
+	void	   *dst;
+	void	   *src;
+	uint32_t	width, height;		/* destination */
+
+	const struct convert_scaler *scaler;
+
+	/* NULL : whole frame, else one byte per tile, the bands are tile rows */
+	const uint8_t  *tiles;
+	uint32_t		tile;
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static const struct converter *find_converter(uint32_t src_format, uint32_t dst_format);
+static bool get_layout(uint32_t format, uint32_t width, uint32_t height, struct frame_layout *layout);
+static bool run_job(struct worker_ctx *workers, struct band_job *job);
+static row_func get_row_func(const struct converter *conv, enum convert_matrix matrix, enum convert_impl impl);
+
+static void convert_range(yuyv_span_func span, uint8_t *dst, const uint8_t *src, size_t start, size_t end);
+static void convert_band(void *arg, unsigned int index, unsigned int count);
+
+static void band_copy(const struct band_job *job, uint32_t first, uint32_t last);
+static void band_yuyv(const struct band_job *job, uint32_t first, uint32_t last);
+static void band_rows(const struct band_job *job, uint32_t first, uint32_t last);
+static void band_tiles(const struct band_job *job, uint32_t first, uint32_t last);
+
+TEMPLATE void scale_box_tmpl(const struct convert_scaler *scaler, uint8_t *dst, const uint8_t *src,
+	uint32_t first, uint32_t last, const struct colour_matrix *m);
+TEMPLATE void scale_bilinear_tmpl(const struct convert_scaler *scaler, uint8_t *dst, const uint8_t *src,
+	uint32_t first, uint32_t last, const struct colour_matrix *m);
+
+static uint32_t bilinear_position(uint32_t dst_pos, uint32_t dst_size, uint32_t src_size,
+	uint32_t *pos0, uint32_t *pos1);
+static inline int bilinear_sample(const uint8_t *r0, const uint8_t *r1, size_t off0, size_t off1,
+	uint32_t fx, uint32_t fy);
+
+TEMPLATE int matrix_luma(int y, const struct colour_matrix *m);
+TEMPLATE void matrix_pixel(uint8_t *dst, int y, int u, int v, const struct colour_matrix *m);
+
+static bool cpu_has_none(void);
+
+#define DECLARE_C_KERNELS(name, matrix)															\
+	static void yuyv_span_c_##name(uint8_t *dst, const uint8_t *src, size_t pairs);				\
+	static void yuyv_span_generic_##name(uint8_t *dst, const uint8_t *src, size_t pairs);		\
+	static void row_c_##name(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,	\
+		uint32_t row, uint32_t width);															\
+	static void scale_box_##name(const struct convert_scaler *scaler, uint8_t *dst,				\
+		const uint8_t *src, uint32_t first, uint32_t last);										\
+	static void scale_bilinear_##name(const struct convert_scaler *scaler, uint8_t *dst,		\
+		const uint8_t *src, uint32_t first, uint32_t last);
+
+FOR_EACH_MATRIX(DECLARE_C_KERNELS)
+
+#ifdef CONVERT_X86
+#define DECLARE_ROW(func, name)																	\
+	static void func##_##name(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,	\
+		uint32_t row, uint32_t width);
+
+#define DECLARE_X86_KERNELS(name, matrix)													\
+	static void yuyv_span_sse2_##name(uint8_t *dst, const uint8_t *src, size_t pairs);		\
+	static void yuyv_span_ssse3_##name(uint8_t *dst, const uint8_t *src, size_t pairs);	\
+	static void yuyv_span_avx2_##name(uint8_t *dst, const uint8_t *src, size_t pairs);		\
+	DECLARE_ROW(uyvy_row_sse2, name)	DECLARE_ROW(uyvy_row_avx2, name)					\
+	DECLARE_ROW(nv12_row_sse2, name)	DECLARE_ROW(nv12_row_avx2, name)					\
+	DECLARE_ROW(nv21_row_sse2, name)	DECLARE_ROW(nv21_row_avx2, name)					\
+	DECLARE_ROW(i420_row_sse2, name)	DECLARE_ROW(i420_row_avx2, name)					\
+	DECLARE_ROW(grey_row_sse2, name)
+
+FOR_EACH_MATRIX(DECLARE_X86_KERNELS)
+
+static bool cpu_has_sse2(void);
+static bool cpu_has_ssse3(void);
+static bool cpu_has_avx2(void);
+#endif /* CONVERT_X86 */
+
+
+/*======================================
+	Variable
+======================================*/
+
+static const struct impl_desc impls[CONVERT_IMPL_NR] = {
+	[CONVERT_IMPL_C]		= { "c",		cpu_has_none },
+	[CONVERT_IMPL_GENERIC]	= { "generic",	cpu_has_none },
+#ifdef CONVERT_X86
+	[CONVERT_IMPL_SSE2]		= { "sse2",		cpu_has_sse2 },
+	[CONVERT_IMPL_SSSE3]	= { "ssse3",	cpu_has_ssse3 },
+	[CONVERT_IMPL_AVX2]		= { "avx2",		cpu_has_avx2 },
+#else
+	[CONVERT_IMPL_SSE2]		= { "sse2",		NULL },
+	[CONVERT_IMPL_SSSE3]	= { "ssse3",	NULL },
+	[CONVERT_IMPL_AVX2]		= { "avx2",		NULL },
+#endif /* CONVERT_X86 */
+};
+
+/* 8bit fixed point, see struct colour_matrix */
+static const struct colour_matrix matrices[CONVERT_MATRIX_NR] = {
+	[CONVERT_MATRIX_LEGACY]			= { "legacy",			 0,  0, COEF_RV, COEF_GU, COEF_GV, COEF_BU,   0 },
+	[CONVERT_MATRIX_BT601_LIMITED]	= { "bt601-limited",	16, 42,     409,     100,     208,     516, 128 },
+	[CONVERT_MATRIX_BT601_FULL]		= { "bt601-full",		 0,  0,     359,      88,     183,     454, 128 },
+	[CONVERT_MATRIX_BT709_LIMITED]	= { "bt709-limited",	16, 42,     459,      55,     136,     541, 128 },
+	[CONVERT_MATRIX_BT709_FULL]		= { "bt709-full",		 0,  0,     403,      48,     120,     475, 128 },
+};
+
+#ifdef CONVERT_X86
+#define YUYV_SPANS(name)	{ yuyv_span_c_##name, yuyv_span_generic_##name,					\
+							  yuyv_span_sse2_##name, yuyv_span_ssse3_##name, yuyv_span_avx2_##name }
+#define ROWS(format, name)	{ [CONVERT_IMPL_C]		= row_c_##name,							\
+							  [CONVERT_IMPL_SSE2]	= format##_row_sse2_##name,				\
+							  [CONVERT_IMPL_AVX2]	= format##_row_avx2_##name }
+#define GREY_ROWS(name)		{ [CONVERT_IMPL_C]		= row_c_##name,							\
+							  [CONVERT_IMPL_SSE2]	= grey_row_sse2_##name }
+#else
+#define YUYV_SPANS(name)	{ yuyv_span_c_##name, yuyv_span_generic_##name }
+#define ROWS(format, name)	{ [CONVERT_IMPL_C] = row_c_##name }
+#define GREY_ROWS(name)		{ [CONVERT_IMPL_C] = row_c_##name }
+#endif /* CONVERT_X86 */
+
+#define UYVY_ROWS(name)		ROWS(uyvy, name)
+#define NV12_ROWS(name)		ROWS(nv12, name)
+#define NV21_ROWS(name)		ROWS(nv21, name)
+#define I420_ROWS(name)		ROWS(i420, name)
+
+static const yuyv_span_func yuyv_spans[CONVERT_MATRIX_NR][CONVERT_IMPL_NR] = MATRIX_TABLE(YUYV_SPANS);
+
+#define SCALES(name)		{ [CONVERT_SCALE_BOX]		= scale_box_##name,					\
+							  [CONVERT_SCALE_BILINEAR]	= scale_bilinear_##name }
+
+static const scale_func scales[CONVERT_MATRIX_NR][CONVERT_SCALE_NR] = MATRIX_TABLE(SCALES);
+
+/*
+ * Registry of (source, destination) pairs. The cost is roughly the bits read
+ * per pixel, GREY is ranked last since it drops colour altogether.
+ */
+static const struct converter converters[] = {
+	/* pass-through to a compositor that takes the camera format */
+	{ FORMAT_YUYV,		FORMAT_YUYV,		0,	band_copy },
+	{ FORMAT_UYVY,		FORMAT_UYVY,		0,	band_copy },
+	{ FORMAT_NV12,		FORMAT_NV12,		0,	band_copy },
+	{ FORMAT_NV21,		FORMAT_NV21,		0,	band_copy },
+	{ FORMAT_YUV420,	FORMAT_YUV420,		0,	band_copy },
+
+	{ FORMAT_NV12,		FORMAT_XRGB8888,	12,	band_rows,	MATRIX_TABLE(NV12_ROWS) },
+	{ FORMAT_NV21,		FORMAT_XRGB8888,	12,	band_rows,	MATRIX_TABLE(NV21_ROWS) },
+	{ FORMAT_YUV420,	FORMAT_XRGB8888,	12,	band_rows,	MATRIX_TABLE(I420_ROWS) },
+	{ FORMAT_YUYV,		FORMAT_XRGB8888,	16,	band_yuyv },
+	{ FORMAT_UYVY,		FORMAT_XRGB8888,	16,	band_rows,	MATRIX_TABLE(UYVY_ROWS) },
+	{ FORMAT_GREY,		FORMAT_XRGB8888,	64,	band_rows,	MATRIX_TABLE(GREY_ROWS) },
+};
+
+static enum convert_impl current_impl = CONVERT_IMPL_C;
+static enum convert_matrix current_matrix = CONVERT_MATRIX_LEGACY;
+
 
 /*======================================
 	Public function
 ======================================*/
 
+bool
+convert_init(void)
+{
+	int impl;
+
+	/* highest supported implementation wins */
+	for (impl = CONVERT_IMPL_NR - 1; impl > CONVERT_IMPL_C; impl--)
+		if (convert_impl_is_supported(impl))
+			break;
+
+	current_impl = impl;
+
+	return true;
+}
+
+bool
+convert_set_impl(enum convert_impl impl)
+{
+	if (!convert_impl_is_supported(impl))
+		return false;
+
+	current_impl = impl;
+
+	return true;
+}
+
+enum convert_impl
+convert_get_impl(void)
+{
+	return current_impl;
+}
+
+bool
+convert_impl_is_supported(enum convert_impl impl)
+{
+	if (impl >= CONVERT_IMPL_NR)
+		return false;
+
+	if (!impls[impl].is_supported)
+		return false;
+
+	return impls[impl].is_supported();
+}
+
+const char *
+convert_impl_get_name(enum convert_impl impl)
+{
+	if (impl >= CONVERT_IMPL_NR)
+		return "unknown";
+
+	return impls[impl].name;
+}
+
+bool
+convert_set_matrix(enum convert_matrix matrix)
+{
+	if (matrix >= CONVERT_MATRIX_NR)
+		return false;
+
+	current_matrix = matrix;
+
+	return true;
+}
+
+enum convert_matrix
+convert_get_matrix(void)
+{
+	return current_matrix;
+}
+
+const char *
+convert_matrix_get_name(enum convert_matrix matrix)
+{
+	if (matrix >= CONVERT_MATRIX_NR)
+		return "unknown";
+
+	return matrices[matrix].name;
+}
+
 bool
 convert_yuyv_to_bgrx8888(void *dst, void *src, uint32_t width, uint32_t height)
 {
@@ -117,3 +511,1224 @@ convert_yuyv_to_bgrx8888(void *dst, void *src, uint32_t width, uint32_t height)
 	return true;
 }
 
+/* the convert_yuyv_to_bgrx8888*() family always uses the legacy matrix */
+bool
+convert_yuyv_to_bgrx8888_impl(enum convert_impl impl, void *dst, void *src, uint32_t width, uint32_t height)
+{
+	if (!src || !dst || !width || !height)
+		return false;
+
+	if (!convert_impl_is_supported(impl))
+		return false;
+
+	if (impl == CONVERT_IMPL_C)
+		return convert_yuyv_to_bgrx8888(dst, src, width, height);
+
+	convert_range(yuyv_spans[CONVERT_MATRIX_LEGACY][impl], dst, src, 0, (size_t)width * height);
+
+	return true;
+}
+
+bool
+convert_yuyv_to_bgrx8888_fast(void *dst, void *src, uint32_t width, uint32_t height)
+{
+	return convert_yuyv_to_bgrx8888_impl(current_impl, dst, src, width, height);
+}
+
+bool
+convert_yuyv_to_bgrx8888_rows(void *dst, void *src, uint32_t width, uint32_t height,
+	uint32_t row, uint32_t rows)
+{
+	if (!src || !dst || !width || !height)
+		return false;
+
+	if (row >= height || rows > height - row)
+		return false;
+
+	convert_range(yuyv_spans[CONVERT_MATRIX_LEGACY][current_impl], dst, src,
+			(size_t)row * width, (size_t)(row + rows) * width);
+
+	return true;
+}
+
+bool
+convert_yuyv_to_bgrx8888_parallel(struct worker_ctx *workers, void *dst, void *src,
+	uint32_t width, uint32_t height)
+{
+	return convert_run_impl(current_impl, CONVERT_MATRIX_LEGACY, workers, FORMAT_YUYV, FORMAT_XRGB8888,
+			dst, src, width, height);
+}
+
+bool
+convert_is_supported(uint32_t src_format, uint32_t dst_format)
+{
+	return find_converter(src_format, dst_format) != NULL;
+}
+
+/*
+ * Fills 'formats' with the source formats that convert to 'dst_format',
+ * cheapest first, and returns how many there are.
+ */
+unsigned int
+convert_get_sources(uint32_t dst_format, uint32_t *formats, unsigned int max)
+{
+	unsigned int costs[ARRAY_SIZE(converters)];
+	unsigned int i, j, nr = 0;
+
+	if (!formats)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(converters) && nr < max; i++) {
+		const struct converter *conv = &converters[i];
+
+		if (conv->dst_format != dst_format || conv->src_format == dst_format)
+			continue;
+
+		/* insertion sort, ties keep the table order */
+		for (j = nr; j > 0 && costs[j - 1] > conv->cost; j--) {
+			costs[j]	= costs[j - 1];
+			formats[j]	= formats[j - 1];
+		}
+
+		costs[j]	= conv->cost;
+		formats[j]	= conv->src_format;
+		nr++;
+	}
+
+	return nr;
+}
+
+bool
+convert_run(struct worker_ctx *workers, uint32_t src_format, uint32_t dst_format,
+	void *dst, void *src, uint32_t width, uint32_t height)
+{
+	return convert_run_impl(current_impl, current_matrix, workers, src_format, dst_format,
+			dst, src, width, height);
+}
+
+bool
+convert_run_impl(enum convert_impl impl, enum convert_matrix matrix, struct worker_ctx *workers,
+	uint32_t src_format, uint32_t dst_format, void *dst, void *src, uint32_t width, uint32_t height)
+{
+	struct band_job job;
+
+	if (!src || !dst || !width || !height)
+		return false;
+
+	if (!convert_impl_is_supported(impl) || matrix >= CONVERT_MATRIX_NR)
+		return false;
+
+	job.conv = find_converter(src_format, dst_format);
+	if (!job.conv)
+		return false;
+
+	if (!get_layout(src_format, width, height, &job.layout))
+		return false;
+
+	job.impl	= impl;
+	job.matrix	= matrix;
+	job.dst		= dst;
+	job.src		= src;
+	job.width	= width;
+	job.height	= height;
+	job.scaler	= NULL;
+	job.tiles	= NULL;
+
+	return run_job(workers, &job);
+}
+
+/*
+ * Converts only the tiles of a 'tile' x 'tile' grid flagged in 'tiles', one
+ * byte per tile in row order, the others are left as they are in 'dst'. Only
+ * YUYV is supported, to XRGB8888 or passed through.
+ */
+bool
+convert_run_tiles(struct worker_ctx *workers, uint32_t src_format, uint32_t dst_format,
+	void *dst, void *src, uint32_t width, uint32_t height, uint32_t tile, const uint8_t *tiles)
+{
+	struct band_job job;
+
+	if (!src || !dst || !tiles || !width || !height || !tile || (tile & 1))
+		return false;
+
+	if (src_format != FORMAT_YUYV)
+		return false;
+
+	job.conv = find_converter(src_format, dst_format);
+	if (!job.conv)
+		return false;
+
+	if (!get_layout(src_format, width, height, &job.layout))
+		return false;
+
+	job.impl	= current_impl;
+	job.matrix	= current_matrix;
+	job.dst		= dst;
+	job.src		= src;
+	job.width	= width;
+	job.height	= height;
+	job.scaler	= NULL;
+	job.tiles	= tiles;
+	job.tile	= tile;
+
+	return run_job(workers, &job);
+}
+
+struct convert_scaler *
+convert_scaler_create(uint32_t format, uint32_t src_width, uint32_t src_height,
+	uint32_t dst_width, uint32_t dst_height, enum convert_scale mode)
+{
+	struct convert_scaler *scaler;
+	struct frame_layout layout;
+	uint32_t x;
+
+	if (!get_layout(format, src_width, src_height, &layout) || !dst_width || !dst_height) {
+		LOG_ERROR("Unsupported scale %s %ux%u -> %ux%u", format_get_name(format),
+				src_width, src_height, dst_width, dst_height);
+		return NULL;
+	}
+
+	if (mode >= CONVERT_SCALE_NR)
+		return NULL;
+
+	scaler = (struct convert_scaler *)calloc(1, sizeof(struct convert_scaler));
+	if (!scaler) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	scaler->format		= format;
+	scaler->layout		= layout;
+	scaler->mode		= mode;
+	scaler->src_width	= src_width;
+	scaler->src_height	= src_height;
+	scaler->dst_width	= dst_width;
+	scaler->dst_height	= dst_height;
+
+	if (mode == CONVERT_SCALE_BOX) {
+		scaler->box_x = calloc(dst_width + 1, sizeof(uint32_t));
+		if (!scaler->box_x)
+			goto err;
+
+		for (x = 0; x <= dst_width; x++)
+			scaler->box_x[x] = (uint64_t)x * src_width / dst_width;
+	} else {
+		scaler->taps = calloc(dst_width, sizeof(struct bilinear_tap));
+		if (!scaler->taps)
+			goto err;
+
+		for (x = 0; x < dst_width; x++) {
+			struct bilinear_tap *tap = &scaler->taps[x];
+
+			tap->yf = bilinear_position(x, dst_width, src_width, &tap->y0, &tap->y1);
+			tap->cf = bilinear_position(x, dst_width, (src_width + 1) / 2, &tap->c0, &tap->c1);
+		}
+	}
+
+	return scaler;
+
+err:
+	LOG_ERROR("Out of Memory");
+	convert_scaler_destroy(scaler);
+	return NULL;
+}
+
+void
+convert_scaler_destroy(struct convert_scaler *scaler)
+{
+	if (!scaler)
+		return;
+
+	free(scaler->box_x);
+	free(scaler->taps);
+	free(scaler);
+}
+
+bool
+convert_scaler_matches(struct convert_scaler *scaler, uint32_t format, uint32_t src_width, uint32_t src_height,
+	uint32_t dst_width, uint32_t dst_height)
+{
+	if (!scaler)
+		return false;
+
+	return scaler->format == format
+		&& scaler->src_width == src_width && scaler->src_height == src_height
+		&& scaler->dst_width == dst_width && scaler->dst_height == dst_height;
+}
+
+/*
+ * Scales and converts in a single pass : every destination pixel is built
+ * from the samples it covers and converted once, so only the pixels that are
+ * actually shown are ever converted.
+ */
+bool
+convert_scaler_run(struct convert_scaler *scaler, struct worker_ctx *workers, void *dst, void *src)
+{
+	struct band_job job;
+
+	if (!scaler || !dst || !src)
+		return false;
+
+	job.conv	= NULL;
+	job.impl	= current_impl;
+	job.matrix	= current_matrix;
+	job.layout	= scaler->layout;
+	job.dst		= dst;
+	job.src		= src;
+	job.width	= scaler->dst_width;
+	job.height	= scaler->dst_height;
+	job.scaler	= scaler;
+	job.tiles	= NULL;
+
+	return run_job(workers, &job);
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+static const struct converter *
+find_converter(uint32_t src_format, uint32_t dst_format)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(converters); i++)
+		if (converters[i].src_format == src_format && converters[i].dst_format == dst_format)
+			return &converters[i];
+
+	return NULL;
+}
+
+/*
+ * Frames are packed (no bytesperline padding), chroma is subsampled by 2 so
+ * 4:2:2 needs an even width and 4:2:0 an even width and height.
+ */
+static bool
+get_layout(uint32_t format, uint32_t width, uint32_t height, struct frame_layout *layout)
+{
+	size_t luma = (size_t)width * height;
+
+	if (!width || !height)
+		return false;
+
+	memset(layout, 0, sizeof(*layout));
+
+	switch (format) {
+	case FORMAT_YUYV:
+	case FORMAT_UYVY:
+		if (width & 1)
+			return false;
+
+		layout->y			= (format == FORMAT_YUYV) ? 0 : 1;
+		layout->u			= (format == FORMAT_YUYV) ? 1 : 0;
+		layout->v			= layout->u + 2;
+		layout->y_stride	= (size_t)width * 2;
+		layout->c_stride	= layout->y_stride;
+		layout->y_step		= 2;
+		layout->c_step		= 4;
+		layout->chroma		= true;
+		break;
+	case FORMAT_NV12:
+	case FORMAT_NV21:
+	case FORMAT_YUV420:
+		if ((width & 1) || (height & 1))
+			return false;
+
+		layout->y_stride	= width;
+		layout->y_step		= 1;
+		layout->c_vshift	= 1;
+		layout->chroma		= true;
+
+		if (format == FORMAT_YUV420) {
+			layout->u			= luma;
+			layout->v			= luma + luma / 4;
+			layout->c_stride	= width / 2;
+			layout->c_step		= 1;
+		} else {
+			layout->u			= (format == FORMAT_NV12) ? luma : luma + 1;
+			layout->v			= (format == FORMAT_NV12) ? luma + 1 : luma;
+			layout->c_stride	= width;
+			layout->c_step		= 2;
+		}
+		break;
+	case FORMAT_GREY:
+		layout->y_stride	= width;
+		layout->y_step		= 1;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+run_job(struct worker_ctx *workers, struct band_job *job)
+{
+	if (!workers || worker_get_threads(workers) < 2) {
+		convert_band(job, 0, 1);
+		return true;
+	}
+
+	return worker_run(workers, convert_band, job);
+}
+
+static row_func
+get_row_func(const struct converter *conv, enum convert_matrix matrix, enum convert_impl impl)
+{
+	int i;
+
+	for (i = impl; i > CONVERT_IMPL_C; i--)
+		if (conv->row[matrix][i])
+			return conv->row[matrix][i];
+
+	return conv->row[matrix][CONVERT_IMPL_C];
+}
+
+/*
+ * Converts pixels [start, end) of a frame. The frame is a packed stream of
+ * macropixels, so a range may begin or end in the middle of one; the kernels
+ * themselves only ever see whole macropixels, the odd halves go through a
+ * one macropixel span.
+ */
+static void
+convert_range(yuyv_span_func span, uint8_t *dst, const uint8_t *src, size_t start, size_t end)
+{
+	uint8_t pair[8];
+
+	if (start >= end)
+		return;
+
+	/* second half of a macropixel */
+	if (start & 1) {
+		span(pair, src + (start - 1) * 2, 1);
+		memcpy(dst + start * 4, pair + 4, 4);
+
+		if (++start == end)
+			return;
+	}
+
+	span(dst + start * 4, src + start * 2, (end - start) / 2);
+
+	/* first half of a macropixel */
+	if ((end - start) & 1) {
+		span(pair, src + (end - 1) * 2, 1);
+		memcpy(dst + (end - 1) * 4, pair, 4);
+	}
+}
+
+static void
+convert_band(void *arg, unsigned int index, unsigned int count)
+{
+	struct band_job *job = arg;
+	uint32_t rows = job->tiles ? (job->height + job->tile - 1) / job->tile : job->height;
+	uint32_t first, last;
+
+	first	= (uint64_t)rows * index / count;
+	last	= (uint64_t)rows * (index + 1) / count;
+
+	if (last <= first)
+		return;
+
+	if (job->tiles)
+		band_tiles(job, first, last);
+	else if (job->conv)
+		job->conv->band(job, first, last);
+	else
+		scales[job->matrix][job->scaler->mode](job->scaler, job->dst, job->src, first, last);
+}
+
+/* pass-through, the band is cut by bytes so planar frames split evenly too */
+static void
+band_copy(const struct band_job *job, uint32_t first, uint32_t last)
+{
+	size_t size = format_get_frame_size(job->conv->src_format, job->width, job->height);
+	size_t start, end;
+
+	start	= (uint64_t)size * first / job->height;
+	end		= (uint64_t)size * last / job->height;
+
+	memcpy((uint8_t *)job->dst + start, (const uint8_t *)job->src + start, end - start);
+}
+
+static void
+band_yuyv(const struct band_job *job, uint32_t first, uint32_t last)
+{
+	convert_range(yuyv_spans[job->matrix][job->impl], job->dst, job->src,
+			(size_t)first * job->width, (size_t)last * job->width);
+}
+
+static void
+band_rows(const struct band_job *job, uint32_t first, uint32_t last)
+{
+	row_func row = get_row_func(job->conv, job->matrix, job->impl);
+	uint8_t *dst = (uint8_t *)job->dst + (size_t)first * job->width * 4;
+	uint32_t y;
+
+	for (y = first; y < last; y++, dst += (size_t)job->width * 4)
+		row(dst, job->src, &job->layout, y, job->width);
+}
+
+/* tile rows [first, last), runs of flagged tiles on a row are done at once */
+static void
+band_tiles(const struct band_job *job, uint32_t first, uint32_t last)
+{
+	yuyv_span_func span = NULL;
+	uint32_t tiles_x = (job->width + job->tile - 1) / job->tile;
+	uint32_t tx, end, x0, x1, y, y0, y1;
+	size_t start, stop;
+
+	if (job->conv->band == band_yuyv)
+		span = yuyv_spans[job->matrix][job->impl];
+
+	for (; first < last; first++) {
+		const uint8_t *map = job->tiles + (size_t)first * tiles_x;
+
+		y0 = first * job->tile;
+		y1 = y0 + job->tile < job->height ? y0 + job->tile : job->height;
+
+		for (tx = 0; tx < tiles_x; tx = end) {
+			for (; tx < tiles_x && !map[tx]; tx++)
+				;
+			for (end = tx; end < tiles_x && map[end]; end++)
+				;
+			if (tx == end)
+				break;
+
+			x0 = tx * job->tile;
+			x1 = end * job->tile < job->width ? end * job->tile : job->width;
+
+			for (y = y0; y < y1; y++) {
+				start	= (size_t)y * job->width + x0;
+				stop	= (size_t)y * job->width + x1;
+
+				if (span)
+					convert_range(span, job->dst, job->src, start, stop);
+				else
+					memcpy((uint8_t *)job->dst + start * 2, (const uint8_t *)job->src + start * 2,
+							(stop - start) * 2);
+			}
+		}
+	}
+}
+
+TEMPLATE void
+scale_box_tmpl(const struct convert_scaler *scaler, uint8_t *dst, const uint8_t *src,
+	uint32_t first, uint32_t last, const struct colour_matrix *m)
+{
+	const struct frame_layout *layout = &scaler->layout;
+	uint32_t dy, dx, sy, sx;
+
+	dst += (size_t)first * scaler->dst_width * 4;
+
+	for (dy = first; dy < last; dy++) {
+		uint32_t y0 = (uint64_t)dy * scaler->src_height / scaler->dst_height;
+		uint32_t y1 = (uint64_t)(dy + 1) * scaler->src_height / scaler->dst_height;
+
+		/* upscaling : repeat the nearest row / column */
+		if (y1 <= y0)
+			y1 = y0 + 1;
+
+		for (dx = 0; dx < scaler->dst_width; dx++, dst += 4) {
+			uint32_t x0 = scaler->box_x[dx];
+			uint32_t x1 = scaler->box_x[dx + 1];
+			uint32_t m0, m1, sum_y = 0, sum_u = 0, sum_v = 0, n_y, n_c;
+
+			if (x1 <= x0)
+				x1 = x0 + 1;
+
+			/* chroma columns touched by the box */
+			m0 = x0 / 2;
+			m1 = (x1 + 1) / 2;
+
+			for (sy = y0; sy < y1; sy++) {
+				const uint8_t *row = src + layout->y + sy * layout->y_stride;
+				size_t c_row = (sy >> layout->c_vshift) * layout->c_stride;
+
+				for (sx = x0; sx < x1; sx++)
+					sum_y += row[sx * layout->y_step];
+
+				if (!layout->chroma)
+					continue;
+
+				for (sx = m0; sx < m1; sx++) {
+					sum_u += src[layout->u + c_row + sx * layout->c_step];
+					sum_v += src[layout->v + c_row + sx * layout->c_step];
+				}
+			}
+
+			n_y = (x1 - x0) * (y1 - y0);
+			n_c = (m1 - m0) * (y1 - y0);
+
+			if (layout->chroma)
+				matrix_pixel(dst, sum_y / n_y, (int)(sum_u / n_c) - 128, (int)(sum_v / n_c) - 128, m);
+			else
+				matrix_pixel(dst, sum_y / n_y, 0, 0, m);
+		}
+	}
+}
+
+TEMPLATE void
+scale_bilinear_tmpl(const struct convert_scaler *scaler, uint8_t *dst, const uint8_t *src,
+	uint32_t first, uint32_t last, const struct colour_matrix *m)
+{
+	const struct frame_layout *layout = &scaler->layout;
+	uint32_t c_height = scaler->src_height >> layout->c_vshift;
+	uint32_t dy, dx;
+
+	dst += (size_t)first * scaler->dst_width * 4;
+
+	for (dy = first; dy < last; dy++) {
+		const uint8_t *r0, *r1, *u0, *u1, *v0, *v1;
+		uint32_t sy0, sy1, cy0, cy1, fy, cfy;
+
+		fy	= bilinear_position(dy, scaler->dst_height, scaler->src_height, &sy0, &sy1);
+		cfy	= bilinear_position(dy, scaler->dst_height, c_height, &cy0, &cy1);
+
+		r0 = src + layout->y + sy0 * layout->y_stride;
+		r1 = src + layout->y + sy1 * layout->y_stride;
+		u0 = src + layout->u + cy0 * layout->c_stride;
+		u1 = src + layout->u + cy1 * layout->c_stride;
+		v0 = src + layout->v + cy0 * layout->c_stride;
+		v1 = src + layout->v + cy1 * layout->c_stride;
+
+		for (dx = 0; dx < scaler->dst_width; dx++, dst += 4) {
+			const struct bilinear_tap *tap = &scaler->taps[dx];
+			size_t c0 = tap->c0 * layout->c_step, c1 = tap->c1 * layout->c_step;
+			int y, u = 128, v = 128;
+
+			y = bilinear_sample(r0, r1, tap->y0 * layout->y_step, tap->y1 * layout->y_step, tap->yf, fy);
+			if (layout->chroma) {
+				u = bilinear_sample(u0, u1, c0, c1, tap->cf, cfy);
+				v = bilinear_sample(v0, v1, c0, c1, tap->cf, cfy);
+			}
+
+			matrix_pixel(dst, y, u - 128, v - 128, m);
+		}
+	}
+}
+
+/* samples at pixel centres in 16.16 fixed point, returns the 8bit weight of pos1 */
+static uint32_t
+bilinear_position(uint32_t dst_pos, uint32_t dst_size, uint32_t src_size,
+	uint32_t *pos0, uint32_t *pos1)
+{
+	int64_t pos;
+
+	pos = ((int64_t)(2 * dst_pos + 1) * src_size << 16) / (2 * dst_size) - 0x8000;
+	if (pos < 0)
+		pos = 0;
+
+	*pos0 = pos >> 16;
+	*pos1 = *pos0 + 1 < src_size ? *pos0 + 1 : *pos0;
+
+	return (pos >> 8) & 0xff;
+}
+
+/* 8bit weights : horizontal lerp on both rows, then vertical with rounding */
+static inline int
+bilinear_sample(const uint8_t *r0, const uint8_t *r1, size_t off0, size_t off1,
+	uint32_t fx, uint32_t fy)
+{
+	uint32_t top, bottom;
+
+	top		= r0[off0] * (256 - fx) + r0[off1] * fx;
+	bottom	= r1[off0] * (256 - fx) + r1[off1] * fx;
+
+	return (top * (256 - fy) + bottom * fy + 0x8000) >> 16;
+}
+
+TEMPLATE int
+matrix_luma(int y, const struct colour_matrix *m)
+{
+	y -= m->y_offset;
+
+	return y + ((y * m->y_gain + m->round) >> 8);
+}
+
+TEMPLATE void
+matrix_pixel(uint8_t *dst, int y, int u, int v, const struct colour_matrix *m)
+{
+	int r, g, b;
+
+	y = matrix_luma(y, m);
+	r = y + (                  (m->rv * v + m->round)  >> 8);
+	g = y - (((m->gu * u) + (m->gv * v) + m->round) >> 8);
+	b = y + (  (m->bu * u + m->round)                  >> 8);
+
+	dst[0] = CLAMP_U8(b);
+	dst[1] = CLAMP_U8(g);
+	dst[2] = CLAMP_U8(r);
+	dst[3] = 0xff;
+}
+
+TEMPLATE void
+yuyv_span_c_tmpl(uint8_t *dst, const uint8_t *src, size_t pairs, const struct colour_matrix *m)
+{
+	size_t i;
+
+	for (i = 0; i < pairs; i++, src += 4, dst += 8) {
+		matrix_pixel(dst + 0, src[0], src[1] - 128, src[3] - 128, m);
+		matrix_pixel(dst + 4, src[2], src[1] - 128, src[3] - 128, m);
+	}
+}
+
+#ifdef CONVERT_VECTOR
+/* 0 below 0, 255 above 255, the compare gives all ones where it is true */
+TEMPLATE v4si
+clamp_u8_v4(v4si val)
+{
+	val &= ~(val >> 31);
+
+	return (val | (v4si)(val > 255)) & 0xff;
+}
+
+TEMPLATE v4si
+matrix_luma_v4(v4si y, const struct colour_matrix *m)
+{
+	y -= m->y_offset;
+
+	return y + ((y * m->y_gain + m->round) >> 8);
+}
+#endif /* CONVERT_VECTOR */
+
+/*
+ * Portable kernel for targets without the x86 ones : four macropixels per
+ * step, one in each 32bit lane, so Y0, U, Y1 and V are plain shifts and
+ * masks and only the two pixels of a macropixel need interleaving at the
+ * end. Same arithmetic as matrix_pixel(), the tail goes through it.
+ */
+TEMPLATE void
+yuyv_span_generic_tmpl(uint8_t *restrict dst, const uint8_t *restrict src, size_t pairs,
+	const struct colour_matrix *m)
+{
+#ifdef CONVERT_VECTOR
+	for (; pairs >= 4; pairs -= 4, src += 16, dst += 32) {
+		v4su in, out, px0, px1;
+		v4si y0, y1, u, v, dr, dg, db;
+
+		memcpy(&in, src, sizeof(in));
+
+		y0	= matrix_luma_v4((v4si)(in & 0xff), m);
+		u	= (v4si)((in >> 8) & 0xff) - 128;
+		y1	= matrix_luma_v4((v4si)((in >> 16) & 0xff), m);
+		v	= (v4si)(in >> 24) - 128;
+
+		dr	=                  (m->rv * v + m->round)  >> 8;
+		dg	= ((m->gu * u) + (m->gv * v) + m->round) >> 8;
+		db	=  (m->bu * u + m->round)                  >> 8;
+
+		px0	= (v4su)clamp_u8_v4(y0 + db) | (v4su)clamp_u8_v4(y0 - dg) << 8
+			| (v4su)clamp_u8_v4(y0 + dr) << 16 | 0xff000000;
+		px1	= (v4su)clamp_u8_v4(y1 + db) | (v4su)clamp_u8_v4(y1 - dg) << 8
+			| (v4su)clamp_u8_v4(y1 + dr) << 16 | 0xff000000;
+
+		out = ZIP_LO(px0, px1);
+		memcpy(dst, &out, sizeof(out));
+		out = ZIP_HI(px0, px1);
+		memcpy(dst + 16, &out, sizeof(out));
+	}
+#endif /* CONVERT_VECTOR */
+
+	yuyv_span_c_tmpl(dst, src, pairs, m);
+}
+
+/* any layout, converts pixels [x, width) of a row, also the tail of the row kernels */
+TEMPLATE void
+layout_span_c_tmpl(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t x, uint32_t width, const struct colour_matrix *m)
+{
+	const uint8_t *y = src + layout->y + (size_t)row * layout->y_stride;
+	size_t c_row = (size_t)(row >> layout->c_vshift) * layout->c_stride;
+
+	for (; x < width; x++) {
+		int u = 0, v = 0;
+
+		if (layout->chroma) {
+			u = src[layout->u + c_row + (x / 2) * layout->c_step] - 128;
+			v = src[layout->v + c_row + (x / 2) * layout->c_step] - 128;
+		}
+
+		matrix_pixel(dst + x * 4, y[x * layout->y_step], u, v, m);
+	}
+}
+
+#define DEFINE_C_KERNELS(name, matrix)															\
+	static void																					\
+	yuyv_span_c_##name(uint8_t *dst, const uint8_t *src, size_t pairs)							\
+	{																							\
+		yuyv_span_c_tmpl(dst, src, pairs, &matrices[matrix]);									\
+	}																							\
+																								\
+	static void																					\
+	yuyv_span_generic_##name(uint8_t *dst, const uint8_t *src, size_t pairs)					\
+	{																							\
+		yuyv_span_generic_tmpl(dst, src, pairs, &matrices[matrix]);							\
+	}																							\
+																								\
+	static void																					\
+	row_c_##name(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,			\
+		uint32_t row, uint32_t width)															\
+	{																							\
+		layout_span_c_tmpl(dst, src, layout, row, 0, width, &matrices[matrix]);				\
+	}																							\
+																								\
+	static void																					\
+	scale_box_##name(const struct convert_scaler *scaler, uint8_t *dst, const uint8_t *src,		\
+		uint32_t first, uint32_t last)															\
+	{																							\
+		scale_box_tmpl(scaler, dst, src, first, last, &matrices[matrix]);						\
+	}																							\
+																								\
+	static void																					\
+	scale_bilinear_##name(const struct convert_scaler *scaler, uint8_t *dst, const uint8_t *src,	\
+		uint32_t first, uint32_t last)															\
+	{																							\
+		scale_bilinear_tmpl(scaler, dst, src, first, last, &matrices[matrix]);					\
+	}
+
+FOR_EACH_MATRIX(DEFINE_C_KERNELS)
+
+static bool
+cpu_has_none(void)
+{
+	return true;
+}
+
+#ifdef CONVERT_X86
+
+/*
+ * All x86 kernels share the same arithmetic :
+ *
+ *   Y is widened to one word per pixel, U/V to one (U - 128, V - 128) word
+ *   pair per macropixel. pmaddwd of a pair with a coefficient pair gives the
+ *   exact 32bit chroma term of the macropixel, an arithmetic shift by 8
+ *   matches the '>> 8' of the scalar code and the final packuswb does the
+ *   clamp to [0, 255]. The luma gain of limited range fits 16bit lanes.
+ *
+ * The formats only differ in how Y and U/V are loaded and widened, NV21
+ * stores V first and swaps the coefficient pairs instead.
+ */
+
+#define X86_TEMPLATE(isa)	static inline __attribute__((always_inline, target(isa)))
+
+X86_TEMPLATE("sse2") __m128i
+luma_sse2(__m128i y, const struct colour_matrix *m)
+{
+	if (m->y_offset)
+		y = _mm_sub_epi16(y, _mm_set1_epi16(m->y_offset));
+
+	if (m->y_gain)
+		y = _mm_add_epi16(y, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(y, _mm_set1_epi16(m->y_gain)),
+														  _mm_set1_epi16(m->round)), 8));
+
+	return y;
+}
+
+/* one 32bit chroma term per macropixel */
+X86_TEMPLATE("sse2") __m128i
+chroma_sse2(__m128i uv, int coef, const struct colour_matrix *m)
+{
+	__m128i t = _mm_madd_epi16(uv, _mm_set1_epi32(coef));
+
+	if (m->round)
+		t = _mm_add_epi32(t, _mm_set1_epi32(m->round));
+
+	return _mm_srai_epi32(t, 8);
+}
+
+/* 8 pixels : y holds 8 luma words, uv 4 chroma word pairs, V first if 'vu' */
+X86_TEMPLATE("sse2") void
+store_bgrx8_sse2(uint8_t *dst, __m128i y, __m128i uv, bool vu, const struct colour_matrix *m)
+{
+	const __m128i alpha = _mm_set1_epi16(0x00ff);
+	__m128i rg, bb, r, g, b, br, ga, bg, ra;
+
+	y  = luma_sse2(y, m);
+	rg = _mm_packs_epi32(chroma_sse2(uv, vu ? COEF_PAIR(m->rv, 0) : COEF_PAIR(0, m->rv), m),
+						 chroma_sse2(uv, vu ? COEF_PAIR(m->gv, m->gu) : COEF_PAIR(m->gu, m->gv), m));
+	bb = chroma_sse2(uv, vu ? COEF_PAIR(0, m->bu) : COEF_PAIR(m->bu, 0), m);
+	bb = _mm_packs_epi32(bb, bb);
+
+	r = _mm_add_epi16(y, _mm_unpacklo_epi16(rg, rg));
+	g = _mm_sub_epi16(y, _mm_unpackhi_epi16(rg, rg));
+	b = _mm_add_epi16(y, _mm_unpacklo_epi16(bb, bb));
+
+	br = _mm_packus_epi16(b, r);		/* B0..B7 R0..R7 */
+	ga = _mm_packus_epi16(g, alpha);	/* G0..G7 X0..X7 */
+	bg = _mm_unpacklo_epi8(br, ga);
+	ra = _mm_unpackhi_epi8(br, ga);
+
+	_mm_storeu_si128((__m128i *)(dst +  0), _mm_unpacklo_epi16(bg, ra));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(bg, ra));
+}
+
+X86_TEMPLATE("avx2") __m256i
+luma_avx2(__m256i y, const struct colour_matrix *m)
+{
+	if (m->y_offset)
+		y = _mm256_sub_epi16(y, _mm256_set1_epi16(m->y_offset));
+
+	if (m->y_gain)
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(_mm256_add_epi16(_mm256_mullo_epi16(y, _mm256_set1_epi16(m->y_gain)),
+																   _mm256_set1_epi16(m->round)), 8));
+
+	return y;
+}
+
+/* one chroma term per pixel : the low word of each 32bit term, twice */
+X86_TEMPLATE("avx2") __m256i
+chroma_avx2(__m256i uv, int coef, const struct colour_matrix *m)
+{
+	const __m256i dup = _mm256_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13,
+										 0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+	__m256i t = _mm256_madd_epi16(uv, _mm256_set1_epi32(coef));
+
+	if (m->round)
+		t = _mm256_add_epi32(t, _mm256_set1_epi32(m->round));
+
+	return _mm256_shuffle_epi8(_mm256_srai_epi32(t, 8), dup);
+}
+
+/* 16 pixels : lane 0 holds pixels 0..7 and pairs 0..3, lane 1 the rest */
+X86_TEMPLATE("avx2") void
+store_bgrx16_avx2(uint8_t *dst, __m256i y, __m256i uv, bool vu, const struct colour_matrix *m)
+{
+	const __m256i alpha = _mm256_set1_epi16(0x00ff);
+	__m256i r, g, b, br, ga, bg, ra, lo, hi;
+
+	y = luma_avx2(y, m);
+	r = _mm256_add_epi16(y, chroma_avx2(uv, vu ? COEF_PAIR(m->rv, 0) : COEF_PAIR(0, m->rv), m));
+	g = _mm256_sub_epi16(y, chroma_avx2(uv, vu ? COEF_PAIR(m->gv, m->gu) : COEF_PAIR(m->gu, m->gv), m));
+	b = _mm256_add_epi16(y, chroma_avx2(uv, vu ? COEF_PAIR(0, m->bu) : COEF_PAIR(m->bu, 0), m));
+
+	/* in-lane packing : lane 0 holds pixels 0..7, lane 1 pixels 8..15 */
+	br = _mm256_packus_epi16(b, r);
+	ga = _mm256_packus_epi16(g, alpha);
+	bg = _mm256_unpacklo_epi8(br, ga);
+	ra = _mm256_unpackhi_epi8(br, ga);
+	lo = _mm256_unpacklo_epi16(bg, ra);	/* pixels 0..3, 8..11 */
+	hi = _mm256_unpackhi_epi16(bg, ra);	/* pixels 4..7, 12..15 */
+
+	_mm256_storeu_si256((__m256i *)(dst +  0), _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+X86_TEMPLATE("sse2") void
+yuyv_span_sse2_tmpl(uint8_t *dst, const uint8_t *src, size_t pairs, const struct colour_matrix *m)
+{
+	const __m128i mask_y	= _mm_set1_epi16(0x00ff);
+	const __m128i bias		= _mm_set1_epi16(128);
+	size_t i;
+
+	for (i = 0; i + 4 <= pairs; i += 4, src += 16, dst += 32) {
+		__m128i in, y, uv;
+
+		in = _mm_loadu_si128((const __m128i *)src);
+		y  = _mm_and_si128(in, mask_y);
+		uv = _mm_sub_epi16(_mm_srli_epi16(in, 8), bias);
+
+		store_bgrx8_sse2(dst, y, uv, false, m);
+	}
+
+	yuyv_span_c_tmpl(dst, src, pairs - i, m);
+}
+
+X86_TEMPLATE("ssse3") void
+yuyv_span_ssse3_tmpl(uint8_t *dst, const uint8_t *src, size_t pairs, const struct colour_matrix *m)
+{
+	const __m128i mask_y	= _mm_set1_epi16(0x00ff);
+	const __m128i bias		= _mm_set1_epi16(128);
+	const __m128i alpha		= _mm_set1_epi16(0x00ff);
+	/* low word of each dword, twice : one chroma term per pixel */
+	const __m128i dup		= _mm_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+	size_t i;
+
+	for (i = 0; i + 4 <= pairs; i += 4, src += 16, dst += 32) {
+		__m128i in, y, uv, r, g, b, br, ga, bg, ra;
+
+		in = _mm_loadu_si128((const __m128i *)src);
+		y  = luma_sse2(_mm_and_si128(in, mask_y), m);
+		uv = _mm_sub_epi16(_mm_srli_epi16(in, 8), bias);
+
+		r = _mm_add_epi16(y, _mm_shuffle_epi8(chroma_sse2(uv, COEF_PAIR(0, m->rv), m), dup));
+		g = _mm_sub_epi16(y, _mm_shuffle_epi8(chroma_sse2(uv, COEF_PAIR(m->gu, m->gv), m), dup));
+		b = _mm_add_epi16(y, _mm_shuffle_epi8(chroma_sse2(uv, COEF_PAIR(m->bu, 0), m), dup));
+
+		br = _mm_packus_epi16(b, r);
+		ga = _mm_packus_epi16(g, alpha);
+		bg = _mm_unpacklo_epi8(br, ga);
+		ra = _mm_unpackhi_epi8(br, ga);
+
+		_mm_storeu_si128((__m128i *)(dst +  0), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(bg, ra));
+	}
+
+	yuyv_span_c_tmpl(dst, src, pairs - i, m);
+}
+
+X86_TEMPLATE("avx2") void
+yuyv_span_avx2_tmpl(uint8_t *dst, const uint8_t *src, size_t pairs, const struct colour_matrix *m)
+{
+	const __m256i mask_y	= _mm256_set1_epi16(0x00ff);
+	const __m256i bias		= _mm256_set1_epi16(128);
+	size_t i;
+
+	for (i = 0; i + 8 <= pairs; i += 8, src += 32, dst += 64) {
+		__m256i in, y, uv;
+
+		in = _mm256_loadu_si256((const __m256i *)src);
+		y  = _mm256_and_si256(in, mask_y);
+		uv = _mm256_sub_epi16(_mm256_srli_epi16(in, 8), bias);
+
+		store_bgrx16_avx2(dst, y, uv, false, m);
+	}
+
+	yuyv_span_c_tmpl(dst, src, pairs - i, m);
+}
+
+X86_TEMPLATE("sse2") void
+uyvy_row_sse2_tmpl(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t width, const struct colour_matrix *m)
+{
+	const uint8_t *p = src + (size_t)row * layout->y_stride;
+	const __m128i mask_uv	= _mm_set1_epi16(0x00ff);
+	const __m128i bias		= _mm_set1_epi16(128);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m128i in, y, uv;
+
+		in = _mm_loadu_si128((const __m128i *)(p + x * 2));
+		y  = _mm_srli_epi16(in, 8);
+		uv = _mm_sub_epi16(_mm_and_si128(in, mask_uv), bias);
+
+		store_bgrx8_sse2(dst + x * 4, y, uv, false, m);
+	}
+
+	layout_span_c_tmpl(dst, src, layout, row, x, width, m);
+}
+
+/* NV12 and NV21 : 8 bytes of the interleaved chroma row cover 8 pixels */
+X86_TEMPLATE("sse2") void
+nv_row_sse2_tmpl(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t width, bool vu, const struct colour_matrix *m)
+{
+	const uint8_t *y_row = src + (size_t)row * layout->y_stride;
+	const uint8_t *c_row = src + (vu ? layout->v : layout->u) + (size_t)(row >> 1) * layout->c_stride;
+	const __m128i zero	= _mm_setzero_si128();
+	const __m128i bias	= _mm_set1_epi16(128);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m128i y, uv;
+
+		y  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y_row + x)), zero);
+		uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(c_row + x)), zero);
+		uv = _mm_sub_epi16(uv, bias);
+
+		store_bgrx8_sse2(dst + x * 4, y, uv, vu, m);
+	}
+
+	layout_span_c_tmpl(dst, src, layout, row, x, width, m);
+}
+
+X86_TEMPLATE("sse2") void
+i420_row_sse2_tmpl(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t width, const struct colour_matrix *m)
+{
+	const uint8_t *y_row = src + (size_t)row * layout->y_stride;
+	const uint8_t *u_row = src + layout->u + (size_t)(row >> 1) * layout->c_stride;
+	const uint8_t *v_row = src + layout->v + (size_t)(row >> 1) * layout->c_stride;
+	const __m128i zero	= _mm_setzero_si128();
+	const __m128i bias	= _mm_set1_epi16(128);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m128i y, u, v, uv;
+		int32_t u4, v4;
+
+		memcpy(&u4, u_row + x / 2, 4);
+		memcpy(&v4, v_row + x / 2, 4);
+		u = _mm_cvtsi32_si128(u4);
+		v = _mm_cvtsi32_si128(v4);
+
+		y  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y_row + x)), zero);
+		uv = _mm_unpacklo_epi8(_mm_unpacklo_epi8(u, v), zero);
+		uv = _mm_sub_epi16(uv, bias);
+
+		store_bgrx8_sse2(dst + x * 4, y, uv, false, m);
+	}
+
+	layout_span_c_tmpl(dst, src, layout, row, x, width, m);
+}
+
+/* no chroma, B = G = R = Y' : only byte shuffling once the luma is expanded */
+X86_TEMPLATE("sse2") void
+grey_row_sse2_tmpl(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t width, const struct colour_matrix *m)
+{
+	const uint8_t *y_row = src + (size_t)row * layout->y_stride;
+	const __m128i zero	= _mm_setzero_si128();
+	const __m128i alpha	= _mm_set1_epi8((char)0xff);
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i y, yy, ya;
+
+		y = _mm_loadu_si128((const __m128i *)(y_row + x));
+
+		if (m->y_offset || m->y_gain)
+			y = _mm_packus_epi16(luma_sse2(_mm_unpacklo_epi8(y, zero), m),
+								 luma_sse2(_mm_unpackhi_epi8(y, zero), m));
+
+		yy = _mm_unpacklo_epi8(y, y);
+		ya = _mm_unpacklo_epi8(y, alpha);
+		_mm_storeu_si128((__m128i *)(dst + x * 4 +  0), _mm_unpacklo_epi16(yy, ya));
+		_mm_storeu_si128((__m128i *)(dst + x * 4 + 16), _mm_unpackhi_epi16(yy, ya));
+
+		yy = _mm_unpackhi_epi8(y, y);
+		ya = _mm_unpackhi_epi8(y, alpha);
+		_mm_storeu_si128((__m128i *)(dst + x * 4 + 32), _mm_unpacklo_epi16(yy, ya));
+		_mm_storeu_si128((__m128i *)(dst + x * 4 + 48), _mm_unpackhi_epi16(yy, ya));
+	}
+
+	layout_span_c_tmpl(dst, src, layout, row, x, width, m);
+}
+
+X86_TEMPLATE("avx2") void
+uyvy_row_avx2_tmpl(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t width, const struct colour_matrix *m)
+{
+	const uint8_t *p = src + (size_t)row * layout->y_stride;
+	const __m256i mask_uv	= _mm256_set1_epi16(0x00ff);
+	const __m256i bias		= _mm256_set1_epi16(128);
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m256i in, y, uv;
+
+		in = _mm256_loadu_si256((const __m256i *)(p + x * 2));
+		y  = _mm256_srli_epi16(in, 8);
+		uv = _mm256_sub_epi16(_mm256_and_si256(in, mask_uv), bias);
+
+		store_bgrx16_avx2(dst + x * 4, y, uv, false, m);
+	}
+
+	layout_span_c_tmpl(dst, src, layout, row, x, width, m);
+}
+
+X86_TEMPLATE("avx2") void
+nv_row_avx2_tmpl(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t width, bool vu, const struct colour_matrix *m)
+{
+	const uint8_t *y_row = src + (size_t)row * layout->y_stride;
+	const uint8_t *c_row = src + (vu ? layout->v : layout->u) + (size_t)(row >> 1) * layout->c_stride;
+	const __m256i bias = _mm256_set1_epi16(128);
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m256i y, uv;
+
+		y  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y_row + x)));
+		uv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(c_row + x)));
+		uv = _mm256_sub_epi16(uv, bias);
+
+		store_bgrx16_avx2(dst + x * 4, y, uv, vu, m);
+	}
+
+	layout_span_c_tmpl(dst, src, layout, row, x, width, m);
+}
+
+X86_TEMPLATE("avx2") void
+i420_row_avx2_tmpl(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,
+	uint32_t row, uint32_t width, const struct colour_matrix *m)
+{
+	const uint8_t *y_row = src + (size_t)row * layout->y_stride;
+	const uint8_t *u_row = src + layout->u + (size_t)(row >> 1) * layout->c_stride;
+	const uint8_t *v_row = src + layout->v + (size_t)(row >> 1) * layout->c_stride;
+	const __m256i bias = _mm256_set1_epi16(128);
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i u, v;
+		__m256i y, uv;
+
+		u = _mm_loadl_epi64((const __m128i *)(u_row + x / 2));
+		v = _mm_loadl_epi64((const __m128i *)(v_row + x / 2));
+
+		y  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y_row + x)));
+		uv = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u, v));
+		uv = _mm256_sub_epi16(uv, bias);
+
+		store_bgrx16_avx2(dst + x * 4, y, uv, false, m);
+	}
+
+	layout_span_c_tmpl(dst, src, layout, row, x, width, m);
+}
+
+#define DEFINE_SPAN(isa, name, matrix)															\
+	__attribute__((target(#isa)))																\
+	static void																					\
+	yuyv_span_##isa##_##name(uint8_t *dst, const uint8_t *src, size_t pairs)					\
+	{																							\
+		yuyv_span_##isa##_tmpl(dst, src, pairs, &matrices[matrix]);							\
+	}
+
+#define DEFINE_ROW(func, isa, name, matrix, ...)												\
+	__attribute__((target(#isa)))																\
+	static void																					\
+	func##_row_##isa##_##name(uint8_t *dst, const uint8_t *src, const struct frame_layout *layout,	\
+		uint32_t row, uint32_t width)															\
+	{																							\
+		func##_row_##isa##_tmpl(dst, src, layout, row, width, ##__VA_ARGS__, &matrices[matrix]);	\
+	}
+
+/* NV12 / NV21 share a template, 'vu' is the extra argument */
+#define nv12_row_sse2_tmpl	nv_row_sse2_tmpl
+#define nv21_row_sse2_tmpl	nv_row_sse2_tmpl
+#define nv12_row_avx2_tmpl	nv_row_avx2_tmpl
+#define nv21_row_avx2_tmpl	nv_row_avx2_tmpl
+
+#define DEFINE_X86_KERNELS(name, matrix)			\
+	DEFINE_SPAN(sse2, name, matrix)					\
+	DEFINE_SPAN(ssse3, name, matrix)				\
+	DEFINE_SPAN(avx2, name, matrix)					\
+	DEFINE_ROW(uyvy, sse2, name, matrix)			\
+	DEFINE_ROW(uyvy, avx2, name, matrix)			\
+	DEFINE_ROW(nv12, sse2, name, matrix, false)		\
+	DEFINE_ROW(nv12, avx2, name, matrix, false)		\
+	DEFINE_ROW(nv21, sse2, name, matrix, true)		\
+	DEFINE_ROW(nv21, avx2, name, matrix, true)		\
+	DEFINE_ROW(i420, sse2, name, matrix)			\
+	DEFINE_ROW(i420, avx2, name, matrix)			\
+	DEFINE_ROW(grey, sse2, name, matrix)
+
+FOR_EACH_MATRIX(DEFINE_X86_KERNELS)
+
+static bool
+cpu_has_sse2(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("sse2");
+}
+
+static bool
+cpu_has_ssse3(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("ssse3");
+}
+
+static bool
+cpu_has_avx2(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif /* CONVERT_X86 */
@@ -29,6 +29,45 @@
 ======================================*/
 
 #include <stdint.h>
+#include <stdbool.h>
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct worker_ctx;
+struct convert_scaler;
+
+
+/*======================================
+	Constant
+======================================*/
+
+enum convert_impl {
+	CONVERT_IMPL_C = 0,		/* scalar reference */
+	CONVERT_IMPL_GENERIC,	/* portable kernel in gcc / clang vector extensions */
+	CONVERT_IMPL_SSE2,
+	CONVERT_IMPL_SSSE3,
+	CONVERT_IMPL_AVX2,
+	CONVERT_IMPL_NR
+};
+
+/* Y'CbCr to RGB matrix and quantization range */
+enum convert_matrix {
+	CONVERT_MATRIX_LEGACY = 0,		/* convert_yuyv_to_bgrx8888() approximation */
+	CONVERT_MATRIX_BT601_LIMITED,
+	CONVERT_MATRIX_BT601_FULL,
+	CONVERT_MATRIX_BT709_LIMITED,
+	CONVERT_MATRIX_BT709_FULL,
+	CONVERT_MATRIX_NR
+};
+
+enum convert_scale {
+	CONVERT_SCALE_BOX = 0,	/* average of every covered source pixel */
+	CONVERT_SCALE_BILINEAR,
+	CONVERT_SCALE_NR
+};
 
 
 /*======================================
@@ -39,7 +78,38 @@
 extern "C" {
 #endif /* __cplusplus */
 
+bool convert_init(void);
+bool convert_set_impl(enum convert_impl impl);
+enum convert_impl convert_get_impl(void);
+bool convert_impl_is_supported(enum convert_impl impl);
+const char *convert_impl_get_name(enum convert_impl impl);
+
+bool convert_set_matrix(enum convert_matrix matrix);
+enum convert_matrix convert_get_matrix(void);
+const char *convert_matrix_get_name(enum convert_matrix matrix);
+
 bool convert_yuyv_to_bgrx8888(void *dst, void *src, uint32_t width, uint32_t height);
+bool convert_yuyv_to_bgrx8888_impl(enum convert_impl impl, void *dst, void *src, uint32_t width, uint32_t height);
+bool convert_yuyv_to_bgrx8888_fast(void *dst, void *src, uint32_t width, uint32_t height);
+bool convert_yuyv_to_bgrx8888_rows(void *dst, void *src, uint32_t width, uint32_t height, uint32_t row, uint32_t rows);
+bool convert_yuyv_to_bgrx8888_parallel(struct worker_ctx *workers, void *dst, void *src, uint32_t width, uint32_t height);
+
+/* formats are FORMAT_* fourcc codes, see common.h */
+bool convert_is_supported(uint32_t src_format, uint32_t dst_format);
+unsigned int convert_get_sources(uint32_t dst_format, uint32_t *formats, unsigned int max);
+bool convert_run(struct worker_ctx *workers, uint32_t src_format, uint32_t dst_format,
+	void *dst, void *src, uint32_t width, uint32_t height);
+bool convert_run_impl(enum convert_impl impl, enum convert_matrix matrix, struct worker_ctx *workers,
+	uint32_t src_format, uint32_t dst_format, void *dst, void *src, uint32_t width, uint32_t height);
+bool convert_run_tiles(struct worker_ctx *workers, uint32_t src_format, uint32_t dst_format,
+	void *dst, void *src, uint32_t width, uint32_t height, uint32_t tile, const uint8_t *tiles);
+
+struct convert_scaler *convert_scaler_create(uint32_t format, uint32_t src_width, uint32_t src_height,
+	uint32_t dst_width, uint32_t dst_height, enum convert_scale mode);
+void convert_scaler_destroy(struct convert_scaler *scaler);
+bool convert_scaler_matches(struct convert_scaler *scaler, uint32_t format, uint32_t src_width, uint32_t src_height,
+	uint32_t dst_width, uint32_t dst_height);
+bool convert_scaler_run(struct convert_scaler *scaler, struct worker_ctx *workers, void *dst, void *src);
 
 #ifdef __cplusplus
 }
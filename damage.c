@@ -0,0 +1,375 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#include "common.h"
+#include "damage.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define BUFFER_MAX		8	/* as many as wayland.c cycles */
+#define GROUP_SIZE		8	/* bytes, 4 pixels, compared at once */
+
+
+/*======================================
+	Structure
+======================================*/
+
+/* a buffer frames were converted into, and the tiles it missed since */
+struct tracked_buffer {
+	const void	   *buffer;		/* NULL : unused */
+	uint8_t		   *stale;
+	uint64_t		used;
+};
+
+struct damage_ctx {
+	uint32_t		width, height;
+	uint32_t		tile;
+	uint32_t		tiles_x, tiles_y;
+	unsigned int	limit;		/* sum of absolute differences over a group */
+
+	uint8_t		   *reference;	/* YUYV, as of the last time each tile was dirty */
+	bool			valid;		/* false : every tile of the next frame is dirty */
+	uint8_t		   *dirty;		/* of the last frame */
+
+	struct tracked_buffer	buffers[BUFFER_MAX];
+	uint64_t				clock;
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static bool tile_differs(const uint8_t *a, const uint8_t *b, size_t stride, size_t bytes, uint32_t rows,
+	unsigned int limit);
+static struct tracked_buffer *find_buffer(struct damage_ctx *ctx, const void *buffer);
+
+
+/*======================================
+	Public function
+======================================*/
+
+/*
+ * 'tile' is the tile width and height in pixels, a multiple of 8. A tile is
+ * dirty once any 4 pixels on one of its rows differ by more than 'threshold'
+ * per sample on average, which rides out sensor noise but not small motion.
+ */
+struct damage_ctx *
+damage_init(uint32_t width, uint32_t height, uint32_t tile, unsigned int threshold)
+{
+	struct damage_ctx *ctx;
+	size_t tiles_nr;
+	unsigned int i;
+
+	if (!width || !height || !tile || (tile & 7) || threshold > 255) {
+		LOG_ERROR("Unsupported %ux%u, tile %u, threshold %u", width, height, tile, threshold);
+		return NULL;
+	}
+
+	ctx = (struct damage_ctx *)calloc(1, sizeof(struct damage_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->width		= width;
+	ctx->height		= height;
+	ctx->tile		= tile;
+	ctx->tiles_x	= (width + tile - 1) / tile;
+	ctx->tiles_y	= (height + tile - 1) / tile;
+	ctx->limit		= threshold * GROUP_SIZE;
+
+	tiles_nr = (size_t)ctx->tiles_x * ctx->tiles_y;
+
+	ctx->reference = malloc((size_t)width * height * 2);
+	ctx->dirty = calloc(tiles_nr, 1);
+	if (!ctx->reference || !ctx->dirty)
+		goto err;
+
+	for (i = 0; i < BUFFER_MAX; i++) {
+		ctx->buffers[i].stale = calloc(tiles_nr, 1);
+		if (!ctx->buffers[i].stale)
+			goto err;
+	}
+
+	return ctx;
+
+err:
+	LOG_ERROR("Out of Memory");
+	damage_terminate(ctx);
+	return NULL;
+}
+
+void
+damage_terminate(struct damage_ctx *ctx)
+{
+	unsigned int i;
+
+	if (!ctx)
+		return;
+
+	for (i = 0; i < BUFFER_MAX; i++)
+		free(ctx->buffers[i].stale);
+	free(ctx->reference);
+	free(ctx->dirty);
+	free(ctx);
+}
+
+/* the number of tiles, the size of a map */
+unsigned int
+damage_get_tiles(struct damage_ctx *ctx, uint32_t *tiles_x, uint32_t *tiles_y)
+{
+	if (!ctx)
+		return 0;
+
+	if (tiles_x)
+		*tiles_x = ctx->tiles_x;
+	if (tiles_y)
+		*tiles_y = ctx->tiles_y;
+
+	return ctx->tiles_x * ctx->tiles_y;
+}
+
+uint32_t
+damage_get_tile_size(struct damage_ctx *ctx)
+{
+	if (!ctx)
+		return 0;
+
+	return ctx->tile;
+}
+
+/*
+ * Compares a new frame with the reference and returns how many tiles are
+ * dirty. The reference only takes the dirty tiles, so a slow drift still
+ * adds up to a dirty tile eventually. Every tracked buffer is now behind on
+ * the dirty tiles too.
+ */
+unsigned int
+damage_update(struct damage_ctx *ctx, const void *frame)
+{
+	const uint8_t *src = frame;
+	size_t stride, offset, bytes;
+	uint32_t tx, ty, rows, y;
+	unsigned int i, count = 0;
+	uint8_t *dirty;
+
+	if (!ctx || !frame)
+		return 0;
+
+	stride = (size_t)ctx->width * 2;
+
+	if (!ctx->valid) {
+		memcpy(ctx->reference, src, stride * ctx->height);
+		memset(ctx->dirty, 1, (size_t)ctx->tiles_x * ctx->tiles_y);
+		ctx->valid = true;
+		count = ctx->tiles_x * ctx->tiles_y;
+		goto stale;
+	}
+
+	dirty = ctx->dirty;
+	for (ty = 0; ty < ctx->tiles_y; ty++) {
+		rows = ctx->height - ty * ctx->tile < ctx->tile ? ctx->height - ty * ctx->tile : ctx->tile;
+
+		for (tx = 0; tx < ctx->tiles_x; tx++, dirty++) {
+			offset = (size_t)ty * ctx->tile * stride + (size_t)tx * ctx->tile * 2;
+			bytes = ctx->width - tx * ctx->tile < ctx->tile ? ctx->width - tx * ctx->tile : ctx->tile;
+			bytes *= 2;
+
+			*dirty = tile_differs(ctx->reference + offset, src + offset, stride, bytes, rows, ctx->limit);
+			if (!*dirty)
+				continue;
+
+			for (y = 0; y < rows; y++)
+				memcpy(ctx->reference + offset + y * stride, src + offset + y * stride, bytes);
+			count++;
+		}
+	}
+
+stale:
+	if (!count)
+		return 0;
+
+	for (i = 0; i < BUFFER_MAX; i++) {
+		struct tracked_buffer *tracked = &ctx->buffers[i];
+		size_t n;
+
+		if (!tracked->buffer)
+			continue;
+
+		for (n = 0; n < (size_t)ctx->tiles_x * ctx->tiles_y; n++)
+			tracked->stale[n] |= ctx->dirty[n];
+	}
+
+	return count;
+}
+
+/* the tiles the last damage_update() found dirty */
+const uint8_t *
+damage_get_dirty(struct damage_ctx *ctx)
+{
+	if (!ctx)
+		return NULL;
+
+	return ctx->dirty;
+}
+
+/*
+ * The tiles to convert into 'buffer' to bring it up to date, all of them
+ * for a buffer not seen before. The least recently used one is forgotten
+ * when more buffers turn up than are tracked.
+ */
+const uint8_t *
+damage_get_stale(struct damage_ctx *ctx, const void *buffer)
+{
+	struct tracked_buffer *tracked;
+	unsigned int i;
+
+	if (!ctx || !buffer)
+		return NULL;
+
+	tracked = find_buffer(ctx, buffer);
+	if (!tracked) {
+		tracked = &ctx->buffers[0];
+		for (i = 1; i < BUFFER_MAX; i++)
+			if (ctx->buffers[i].used < tracked->used)
+				tracked = &ctx->buffers[i];
+
+		tracked->buffer = buffer;
+		memset(tracked->stale, 1, (size_t)ctx->tiles_x * ctx->tiles_y);
+	}
+
+	tracked->used = ++ctx->clock;
+
+	return tracked->stale;
+}
+
+/* 'buffer' holds the reference now */
+void
+damage_clear_stale(struct damage_ctx *ctx, const void *buffer)
+{
+	struct tracked_buffer *tracked;
+
+	if (!ctx)
+		return;
+
+	tracked = find_buffer(ctx, buffer);
+	if (tracked)
+		memset(tracked->stale, 0, (size_t)ctx->tiles_x * ctx->tiles_y);
+}
+
+/* buffers were filled behind our back, start over from a full frame */
+void
+damage_reset(struct damage_ctx *ctx)
+{
+	unsigned int i;
+
+	if (!ctx)
+		return;
+
+	ctx->valid = false;
+	for (i = 0; i < BUFFER_MAX; i++) {
+		ctx->buffers[i].buffer = NULL;
+		ctx->buffers[i].used = 0;
+	}
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+/* true once a group of 'GROUP_SIZE' bytes on a row differs by more than 'limit' */
+static bool
+tile_differs(const uint8_t *a, const uint8_t *b, size_t stride, size_t bytes, uint32_t rows,
+	unsigned int limit)
+{
+	uint32_t y;
+	size_t x;
+
+	for (y = 0; y < rows; y++, a += stride, b += stride) {
+		x = 0;
+
+#ifdef __SSE2__
+		{
+			/* psadbw sums each 8 byte half on its own, the groups fall out of it */
+			__m128i over = _mm_setzero_si128();
+			__m128i max = _mm_set1_epi16((short)limit);
+
+			for (; x + 16 <= bytes; x += 16) {
+				__m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a + x)),
+						_mm_loadu_si128((const __m128i *)(b + x)));
+
+				over = _mm_or_si128(over, _mm_cmpgt_epi16(sad, max));
+			}
+
+			if (_mm_movemask_epi8(over))
+				return true;
+		}
+#endif /* __SSE2__ */
+
+		for (; x < bytes; x += GROUP_SIZE) {
+			size_t end = x + GROUP_SIZE < bytes ? x + GROUP_SIZE : bytes;
+			unsigned int sad = 0;
+			size_t i;
+
+			for (i = x; i < end; i++)
+				sad += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+
+			if (sad > limit)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static struct tracked_buffer *
+find_buffer(struct damage_ctx *ctx, const void *buffer)
+{
+	unsigned int i;
+
+	for (i = 0; i < BUFFER_MAX; i++)
+		if (ctx->buffers[i].buffer && ctx->buffers[i].buffer == buffer)
+			return &ctx->buffers[i];
+
+	return NULL;
+}
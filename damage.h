@@ -0,0 +1,70 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+#ifndef _DAMAGE_H
+#define _DAMAGE_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*======================================
+	Structure
+======================================*/
+
+/*
+ * Tracks which tiles of a YUYV frame changed, against a reference frame, and
+ * which tiles each buffer it was converted into is behind on. Maps are one
+ * byte per tile in row order, non-zero when the tile is flagged.
+ */
+struct damage_ctx;
+
+
+/*======================================
+	Prototype
+======================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct damage_ctx *damage_init(uint32_t width, uint32_t height, uint32_t tile, unsigned int threshold);
+void damage_terminate(struct damage_ctx *ctx);
+unsigned int damage_get_tiles(struct damage_ctx *ctx, uint32_t *tiles_x, uint32_t *tiles_y);
+uint32_t damage_get_tile_size(struct damage_ctx *ctx);
+
+unsigned int damage_update(struct damage_ctx *ctx, const void *frame);
+const uint8_t *damage_get_dirty(struct damage_ctx *ctx);
+const uint8_t *damage_get_stale(struct damage_ctx *ctx, const void *buffer);
+void damage_clear_stale(struct damage_ctx *ctx, const void *buffer);
+void damage_reset(struct damage_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _DAMAGE_H */
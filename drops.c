@@ -0,0 +1,276 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "common.h"
+#include "drops.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define INTERVAL_BUCKET		10000ULL	/* [ns] */
+#define INTERVAL_BUCKETS	25000		/* up to 250 ms, longer ones go in the last */
+
+
+/*======================================
+	Structure
+======================================*/
+
+/*
+ * Counts of the frames lost at every stage, and the spacing of the capture
+ * timestamps. The capture fields belong to whoever acquires frames, the
+ * counters may be added to from any thread.
+ */
+struct drops_ctx {
+	_Atomic uint64_t	dropped[DROP_REASON_NR];
+	_Atomic uint64_t	shown;
+	atomic_bool			feedback;	/* the sink tells what was shown */
+
+	/* capture side */
+	uint64_t		captured;
+	uint64_t		errors;		/* flagged damaged by the driver, still shown */
+	bool			sequenced;
+	uint32_t		sequence;
+	uint64_t		timestamp;
+
+	/* between consecutive frames, gaps left out */
+	uint32_t	   *intervals;
+	uint64_t		intervals_nr;
+	uint64_t		interval_min, interval_max;
+	double			interval_sum, interval_sum2;
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static uint64_t get_percentile(struct drops_ctx *ctx, unsigned int permille);
+
+
+/*======================================
+	Variable
+======================================*/
+
+static const char *reason_names[DROP_REASON_NR] = {
+	[DROP_DRIVER]		= "lost by the driver",
+	[DROP_MAILBOX]		= "left for a newer one",
+	[DROP_SHORT]		= "truncated",
+	[DROP_OVERWRITTEN]	= "overwritten",
+	[DROP_SKIPPED]		= "skipped",
+	[DROP_DISCARDED]	= "discarded",
+};
+
+
+/*======================================
+	Public function
+======================================*/
+
+struct drops_ctx *
+drops_init(void)
+{
+	struct drops_ctx *ctx;
+
+	ctx = (struct drops_ctx *)calloc(1, sizeof(struct drops_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->intervals = calloc(INTERVAL_BUCKETS, sizeof(ctx->intervals[0]));
+	if (!ctx->intervals) {
+		LOG_ERROR("Out of Memory");
+		free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+void
+drops_terminate(struct drops_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	free(ctx->intervals);
+	free(ctx);
+}
+
+/*
+ * A frame acquired from the source, which counted 'lost' frames it dropped
+ * right before it. Capture intervals are taken between consecutive frames.
+ */
+void
+drops_capture(struct drops_ctx *ctx, uint32_t sequence, uint64_t timestamp, uint32_t lost, bool error)
+{
+	uint64_t interval;
+
+	if (!ctx)
+		return;
+
+	ctx->captured++;
+	if (error)
+		ctx->errors++;
+
+	if (lost)
+		atomic_fetch_add(&ctx->dropped[DROP_DRIVER], lost);
+
+	if (ctx->sequenced && sequence == ctx->sequence + 1 && timestamp > ctx->timestamp) {
+		interval = timestamp - ctx->timestamp;
+
+		if (!ctx->intervals_nr || interval < ctx->interval_min)
+			ctx->interval_min = interval;
+		if (interval > ctx->interval_max)
+			ctx->interval_max = interval;
+
+		ctx->intervals_nr++;
+		ctx->interval_sum	+= interval;
+		ctx->interval_sum2	+= (double)interval * interval;
+
+		interval /= INTERVAL_BUCKET;
+		ctx->intervals[interval < INTERVAL_BUCKETS ? interval : INTERVAL_BUCKETS - 1]++;
+	}
+
+	ctx->sequenced	= true;
+	ctx->sequence	= sequence;
+	ctx->timestamp	= timestamp;
+}
+
+void
+drops_add(struct drops_ctx *ctx, enum drop_reason reason, unsigned int count)
+{
+	if (!ctx || reason >= DROP_REASON_NR)
+		return;
+
+	atomic_fetch_add(&ctx->dropped[reason], count);
+}
+
+/* without, the frames shown and discarded are unknown */
+void
+drops_set_feedback(struct drops_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	atomic_store(&ctx->feedback, true);
+}
+
+void
+drops_shown(struct drops_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	atomic_fetch_add(&ctx->shown, 1);
+}
+
+/*
+ * Frames lost per stage, and the jitter of the capture intervals [ms]
+ * against the nominal rate 'fps', or their mean when it is 0.
+ */
+void
+drops_report(struct drops_ctx *ctx, double fps, FILE *fp)
+{
+	uint64_t dropped[DROP_REASON_NR];
+	double mean, sd, nominal;
+	bool feedback;
+	int i;
+
+	if (!ctx || !fp)
+		return;
+
+	for (i = 0; i < DROP_REASON_NR; i++)
+		dropped[i] = atomic_load(&ctx->dropped[i]);
+	feedback = atomic_load(&ctx->feedback);
+
+	if (feedback)
+		fprintf(fp, "%" PRIu64 " frames captured, %" PRIu64 " shown\n",
+				ctx->captured + dropped[DROP_DRIVER] + dropped[DROP_MAILBOX], atomic_load(&ctx->shown));
+	else
+		fprintf(fp, "%" PRIu64 " frames captured, shown unknown\n",
+				ctx->captured + dropped[DROP_DRIVER] + dropped[DROP_MAILBOX]);
+
+	fprintf(fp, "%-12s %" PRIu64 " %s, %" PRIu64 " flagged damaged\n", "driver",
+			dropped[DROP_DRIVER], reason_names[DROP_DRIVER], ctx->errors);
+	fprintf(fp, "%-12s %" PRIu64 " %s, %" PRIu64 " %s, %" PRIu64 " %s, %" PRIu64 " %s\n", "pipeline",
+			dropped[DROP_MAILBOX], reason_names[DROP_MAILBOX],
+			dropped[DROP_SHORT], reason_names[DROP_SHORT],
+			dropped[DROP_OVERWRITTEN], reason_names[DROP_OVERWRITTEN],
+			dropped[DROP_SKIPPED], reason_names[DROP_SKIPPED]);
+	if (feedback)
+		fprintf(fp, "%-12s %" PRIu64 " %s\n", "compositor",
+				dropped[DROP_DISCARDED], reason_names[DROP_DISCARDED]);
+	else
+		fprintf(fp, "%-12s no presentation feedback\n", "compositor");
+
+	if (!ctx->intervals_nr)
+		return;
+
+	mean	= ctx->interval_sum / ctx->intervals_nr;
+	sd		= sqrt(fmax(ctx->interval_sum2 / ctx->intervals_nr - mean * mean, 0));
+	nominal	= fps > 0 ? 1e9 / fps : mean;
+
+	fprintf(fp, "%-12s %8s %8s %8s %8s %8s %8s %8s [ms]\n", "interval",
+			"nominal", "mean", "sd", "min", "p50", "p99", "max");
+	fprintf(fp, "%-12s %8.2f %8.2f %8.3f %8.2f %8.2f %8.2f %8.2f\n", "",
+			nominal * 1e-6, mean * 1e-6, sd * 1e-6, ctx->interval_min * 1e-6,
+			get_percentile(ctx, 500) * 1e-6, get_percentile(ctx, 990) * 1e-6, ctx->interval_max * 1e-6);
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+/* upper edge of the bucket [ns], within the bucket size */
+static uint64_t
+get_percentile(struct drops_ctx *ctx, unsigned int permille)
+{
+	uint64_t rank = (ctx->intervals_nr * permille + 999) / 1000;
+	uint64_t count = 0;
+	unsigned int i;
+
+	for (i = 0; i < INTERVAL_BUCKETS - 1; i++) {
+		count += ctx->intervals[i];
+		if (count >= rank)
+			return (i + 1) * INTERVAL_BUCKET;
+	}
+
+	return ctx->interval_max;
+}
@@ -0,0 +1,83 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef _DROPS_H
+#define _DROPS_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*======================================
+	Constant
+======================================*/
+
+/* where a captured frame was lost on its way to the screen */
+enum drop_reason {
+	DROP_DRIVER = 0,	/* sequence gap, never dequeued */
+	DROP_MAILBOX,		/* left in the driver queue for a newer one */
+	DROP_SHORT,			/* truncated, not converted */
+	DROP_OVERWRITTEN,	/* converted, reused by the capture thread before it was shown */
+	DROP_SKIPPED,		/* converted, passed over for a newer one when presenting */
+	DROP_DISCARDED,		/* committed, the compositor never showed it */
+	DROP_REASON_NR
+};
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct drops_ctx;
+
+
+/*======================================
+	Prototype
+======================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct drops_ctx *drops_init(void);
+void drops_terminate(struct drops_ctx *ctx);
+
+void drops_capture(struct drops_ctx *ctx, uint32_t sequence, uint64_t timestamp, uint32_t lost,
+	bool error);
+void drops_add(struct drops_ctx *ctx, enum drop_reason reason, unsigned int count);
+void drops_set_feedback(struct drops_ctx *ctx);
+void drops_shown(struct drops_ctx *ctx);
+
+void drops_report(struct drops_ctx *ctx, double fps, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _DROPS_H */
@@ -0,0 +1,240 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "common.h"
+#include "event.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define EVENT_MAX		16
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct source {
+	int				fd;		/* -1 : free slot */
+	event_func		func;
+	void		   *arg;
+};
+
+struct event_ctx {
+	int				epfd;
+	struct source	sources[EVENT_MAX];
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static struct source *find_source(struct event_ctx *ctx, int fd);
+
+
+/*======================================
+	Public function
+======================================*/
+
+struct event_ctx *
+event_init(void)
+{
+	struct event_ctx *ctx;
+	unsigned int i;
+
+	ctx = (struct event_ctx *)calloc(1, sizeof(struct event_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (ctx->epfd < 0) {
+		LOG_PERROR("epoll_create1");
+		free(ctx);
+		return NULL;
+	}
+
+	for (i = 0; i < EVENT_MAX; i++)
+		ctx->sources[i].fd = -1;
+
+	return ctx;
+}
+
+void
+event_terminate(struct event_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	close(ctx->epfd);
+	free(ctx);
+}
+
+/* 'events' is a mask of EPOLL* bits, EPOLLERR and EPOLLHUP are always reported */
+bool
+event_add(struct event_ctx *ctx, int fd, uint32_t events, event_func func, void *arg)
+{
+	struct epoll_event ev;
+	struct source *source;
+
+	if (!ctx || fd < 0 || !func)
+		return false;
+
+	if (find_source(ctx, fd)) {
+		LOG_ERROR("fd %d is already watched", fd);
+		return false;
+	}
+
+	source = find_source(ctx, -1);
+	if (!source) {
+		LOG_ERROR("more than %d event sources", EVENT_MAX);
+		return false;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		LOG_PERROR("EPOLL_CTL_ADD");
+		return false;
+	}
+
+	source->fd = fd;
+	source->func = func;
+	source->arg = arg;
+
+	return true;
+}
+
+/* 0 parks the fd until it is modified again */
+bool
+event_modify(struct event_ctx *ctx, int fd, uint32_t events)
+{
+	struct epoll_event ev;
+
+	if (!ctx || !find_source(ctx, fd))
+		return false;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(ctx->epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+		LOG_PERROR("EPOLL_CTL_MOD");
+		return false;
+	}
+
+	return true;
+}
+
+bool
+event_remove(struct event_ctx *ctx, int fd)
+{
+	struct source *source;
+
+	if (!ctx)
+		return false;
+
+	source = find_source(ctx, fd);
+	if (!source)
+		return false;
+
+	if (epoll_ctl(ctx->epfd, EPOLL_CTL_DEL, fd, NULL) < 0)
+		LOG_PERROR("EPOLL_CTL_DEL");
+
+	source->fd = -1;
+
+	return true;
+}
+
+/*
+ * Waits up to 'timeout' [ms], -1 for ever, and calls back every ready source.
+ * Returns the number of sources called back, 0 on timeout or signal,
+ * -1 on error or when a callback stopped the loop.
+ */
+int
+event_dispatch(struct event_ctx *ctx, int timeout)
+{
+	struct epoll_event evs[EVENT_MAX];
+	int i, n;
+
+	if (!ctx)
+		return -1;
+
+	n = epoll_wait(ctx->epfd, evs, EVENT_MAX, timeout);
+	if (n < 0) {
+		if (errno == EINTR)
+			return 0;
+
+		LOG_PERROR("epoll_wait");
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct source *source;
+
+		/* looked up by fd, an earlier callback may have removed it */
+		source = find_source(ctx, evs[i].data.fd);
+		if (!source)
+			continue;
+
+		if (!source->func(source->arg, source->fd, evs[i].events))
+			return -1;
+	}
+
+	return n;
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+static struct source *
+find_source(struct event_ctx *ctx, int fd)
+{
+	unsigned int i;
+
+	for (i = 0; i < EVENT_MAX; i++)
+		if (ctx->sources[i].fd == fd)
+			return &ctx->sources[i];
+
+	return NULL;
+}
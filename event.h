@@ -0,0 +1,69 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+#ifndef _EVENT_H
+#define _EVENT_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct event_ctx;
+
+/*
+ * Called from event_dispatch() when 'fd' is ready, 'events' holds the
+ * EPOLL* bits that fired. Returning false stops the loop.
+ */
+typedef bool (*event_func)(void *arg, int fd, uint32_t events);
+
+
+/*======================================
+	Prototype
+======================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct event_ctx *event_init(void);
+void event_terminate(struct event_ctx *ctx);
+
+bool event_add(struct event_ctx *ctx, int fd, uint32_t events, event_func func, void *arg);
+bool event_modify(struct event_ctx *ctx, int fd, uint32_t events);
+bool event_remove(struct event_ctx *ctx, int fd);
+
+int event_dispatch(struct event_ctx *ctx, int timeout);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _EVENT_H */
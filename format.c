@@ -0,0 +1,175 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "format.h"
+
+
+/*======================================
+	Structure
+======================================*/
+
+/*
+ * Frames are packed : planes follow each other without padding and the
+ * chroma planes of 4:2:0 formats are subsampled by 2 in both directions.
+ */
+struct format_desc {
+	uint32_t		format;
+	const char	   *name;
+	unsigned int	bpp;		/* bytes per pixel of the first plane, 0 : compressed */
+	unsigned int	chroma;		/* bytes of chroma per 4 pixels, after the first plane */
+};
+
+
+/*======================================
+	Variable
+======================================*/
+
+static const struct format_desc formats[] = {
+	{ FORMAT_ARGB8888,	"ARGB8888",	4, 0 },
+	{ FORMAT_XRGB8888,	"XRGB8888",	4, 0 },
+	{ FORMAT_YUYV,		"YUYV",		2, 0 },
+	{ FORMAT_UYVY,		"UYVY",		2, 0 },
+	{ FORMAT_NV12,		"NV12",		1, 2 },
+	{ FORMAT_NV21,		"NV21",		1, 2 },
+	{ FORMAT_YUV420,	"YUV420",	1, 2 },
+	{ FORMAT_GREY,		"GREY",		1, 0 },
+	{ FORMAT_MJPEG,		"MJPEG",	0, 0 },
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static const struct format_desc *find_format(uint32_t format);
+
+
+/*======================================
+	Public function
+======================================*/
+
+const char *
+format_get_name(uint32_t format)
+{
+	const struct format_desc *desc = find_format(format);
+
+	if (!desc)
+		return "unknown";
+
+	return desc->name;
+}
+
+/* a name as format_get_name() prints it or a fourcc, 0 if unknown */
+uint32_t
+format_from_name(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+		if (strcasecmp(formats[i].name, name) == 0)
+			return formats[i].format;
+
+	if (strlen(name) == 4 && find_format(FOURCC(name[0], name[1], name[2], name[3])))
+		return FOURCC(name[0], name[1], name[2], name[3]);
+
+	return 0;
+}
+
+uint32_t
+format_get_stride(uint32_t format, uint32_t width)
+{
+	const struct format_desc *desc = find_format(format);
+
+	if (!desc)
+		return 0;
+
+	return width * desc->bpp;
+}
+
+/* 0 for compressed formats, their frames vary in size */
+uint32_t
+format_get_frame_size(uint32_t format, uint32_t width, uint32_t height)
+{
+	const struct format_desc *desc = find_format(format);
+
+	if (!desc)
+		return 0;
+
+	return width * height * desc->bpp + width * height / 4 * desc->chroma;
+}
+
+void
+format_fill_white(uint32_t format, void *data, uint32_t width, uint32_t height)
+{
+	uint8_t *p = data;
+	uint32_t i, luma;
+
+	switch (format) {
+	case FORMAT_YUYV:
+	case FORMAT_UYVY:
+		for (i = 0; i < width * height; i++, p += 2) {
+			p[0] = (format == FORMAT_YUYV) ? 0xff : 0x80;
+			p[1] = (format == FORMAT_YUYV) ? 0x80 : 0xff;
+		}
+		break;
+	case FORMAT_NV12:
+	case FORMAT_NV21:
+	case FORMAT_YUV420:
+		luma = width * height;
+		memset(p, 0xff, luma);
+		memset(p + luma, 0x80, format_get_frame_size(format, width, height) - luma);
+		break;
+	default:
+		memset(p, 0xff, format_get_frame_size(format, width, height));
+		break;
+	}
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+static const struct format_desc *
+find_format(uint32_t format)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+		if (formats[i].format == format)
+			return &formats[i];
+
+	return NULL;
+}
@@ -0,0 +1,323 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "latency.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define PENDING_MAX		16		/* frames between commit and feedback */
+#define RECORDS_MAX		8192	/* presented frames the percentiles are taken from */
+
+enum stage {
+	STAGE_QUEUE = 0,	/* capture -> convert start */
+	STAGE_CONVERT,		/* convert start -> end */
+	STAGE_COMMIT,		/* convert end -> commit */
+	STAGE_PRESENT,		/* commit -> presented */
+	STAGE_TOTAL,		/* capture -> presented */
+	STAGE_NR
+};
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct latency_ctx {
+	struct latency_record	pending[PENDING_MAX];
+	bool					pending_used[PENDING_MAX];
+
+	/*
+	 * a uniform sample of the presented frames for the percentiles, of a
+	 * fixed size however long the run (reservoir sampling)
+	 */
+	struct latency_record  *records;
+	size_t					records_nr;
+	uint64_t				presented;
+	uint64_t				max[STAGE_NR];
+	uint64_t				random;		/* xorshift64 state */
+
+	unsigned int			discarded;
+	unsigned int			lost;		/* no room to wait for the feedback */
+
+	FILE				   *log;		/* per-frame CSV, optional */
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static uint64_t get_stage(const struct latency_record *record, enum stage stage);
+static int compare_u64(const void *a, const void *b);
+static uint64_t next_random(struct latency_ctx *ctx);
+
+
+/*======================================
+	Variable
+======================================*/
+
+static const char *stage_names[STAGE_NR] = {
+	[STAGE_QUEUE]	= "queue",
+	[STAGE_CONVERT]	= "convert",
+	[STAGE_COMMIT]	= "commit",
+	[STAGE_PRESENT]	= "present",
+	[STAGE_TOTAL]	= "capture-to-glass",
+};
+
+
+/*======================================
+	Public function
+======================================*/
+
+/* every presented frame is also written to 'log' as CSV when it is set */
+struct latency_ctx *
+latency_init(FILE *log)
+{
+	struct latency_ctx *ctx;
+
+	ctx = (struct latency_ctx *)calloc(1, sizeof(struct latency_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->records = calloc(RECORDS_MAX, sizeof(*ctx->records));
+	if (!ctx->records) {
+		LOG_ERROR("Out of Memory");
+		free(ctx);
+		return NULL;
+	}
+
+	ctx->random = 0x9e3779b97f4a7c15ull;
+	ctx->log = log;
+	if (log)
+		fprintf(log, "sequence,capture_ns,convert_start_ns,convert_end_ns,commit_ns,presented_ns\n");
+
+	return ctx;
+}
+
+void
+latency_terminate(struct latency_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	if (ctx->log)
+		fflush(ctx->log);
+
+	free(ctx->records);
+	free(ctx);
+}
+
+/* a converted frame about to be presented, completed by latency_end() */
+bool
+latency_begin(struct latency_ctx *ctx, const struct latency_record *record)
+{
+	unsigned int i;
+
+	if (!ctx || !record)
+		return false;
+
+	for (i = 0; i < PENDING_MAX; i++) {
+		if (!ctx->pending_used[i]) {
+			ctx->pending[i] = *record;
+			ctx->pending_used[i] = true;
+			return true;
+		}
+	}
+
+	ctx->lost++;
+
+	return false;
+}
+
+/* 'presented' 0 : the compositor discarded the frame */
+void
+latency_end(struct latency_ctx *ctx, uint32_t sequence, uint64_t commit, uint64_t presented)
+{
+	struct latency_record *record = NULL;
+	uint64_t value, slot;
+	unsigned int i;
+	int stage;
+
+	if (!ctx)
+		return;
+
+	for (i = 0; i < PENDING_MAX; i++) {
+		if (ctx->pending_used[i] && ctx->pending[i].sequence == sequence) {
+			record = &ctx->pending[i];
+			ctx->pending_used[i] = false;
+			break;
+		}
+	}
+
+	if (!record)
+		return;
+
+	if (!presented) {
+		ctx->discarded++;
+		return;
+	}
+
+	record->commit = commit;
+	record->presented = presented;
+
+	if (ctx->log)
+		fprintf(ctx->log, "%u,%llu,%llu,%llu,%llu,%llu\n", record->sequence,
+				(unsigned long long)record->capture, (unsigned long long)record->convert_start,
+				(unsigned long long)record->convert_end, (unsigned long long)record->commit,
+				(unsigned long long)record->presented);
+
+	for (stage = 0; stage < STAGE_NR; stage++) {
+		value = get_stage(record, stage);
+		if (value > ctx->max[stage])
+			ctx->max[stage] = value;
+	}
+
+	ctx->presented++;
+
+	if (ctx->records_nr < RECORDS_MAX) {
+		ctx->records[ctx->records_nr++] = *record;
+		return;
+	}
+
+	/* every frame stays in the sample with a chance of RECORDS_MAX / presented */
+	slot = next_random(ctx) % ctx->presented;
+	if (slot < RECORDS_MAX)
+		ctx->records[slot] = *record;
+}
+
+/* percentiles of every stage over the sampled frames, and the maximum over all [ms] */
+void
+latency_report(struct latency_ctx *ctx, FILE *fp)
+{
+	uint64_t *values;
+	size_t i, n;
+	int stage;
+
+	if (!ctx || !fp)
+		return;
+
+	n = ctx->records_nr;
+
+	fprintf(fp, "%llu frames presented, %u discarded, %u not tracked\n",
+			(unsigned long long)ctx->presented, ctx->discarded, ctx->lost);
+	if (n == 0)
+		return;
+
+	if (n < ctx->presented)
+		fprintf(fp, "percentiles over a sample of %zu frames\n", n);
+
+	values = malloc(n * sizeof(*values));
+	if (!values) {
+		LOG_ERROR("Out of Memory");
+		return;
+	}
+
+	fprintf(fp, "%-16s %8s %8s %8s %8s [ms]\n", "stage", "p50", "p90", "p99", "max");
+
+	for (stage = 0; stage < STAGE_NR; stage++) {
+		for (i = 0; i < n; i++)
+			values[i] = get_stage(&ctx->records[i], stage);
+
+		qsort(values, n, sizeof(*values), compare_u64);
+
+		fprintf(fp, "%-16s %8.2f %8.2f %8.2f %8.2f\n", stage_names[stage],
+				values[n * 50 / 100] * 1e-6, values[n * 90 / 100] * 1e-6,
+				values[n * 99 / 100] * 1e-6, ctx->max[stage] * 1e-6);
+	}
+
+	free(values);
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+/* clamped, the V4L2 and presentation clocks may disagree by a little */
+static uint64_t
+get_stage(const struct latency_record *record, enum stage stage)
+{
+	uint64_t from, to;
+
+	switch (stage) {
+	case STAGE_QUEUE:
+		from = record->capture;
+		to = record->convert_start;
+		break;
+	case STAGE_CONVERT:
+		from = record->convert_start;
+		to = record->convert_end;
+		break;
+	case STAGE_COMMIT:
+		from = record->convert_end;
+		to = record->commit;
+		break;
+	case STAGE_PRESENT:
+		from = record->commit;
+		to = record->presented;
+		break;
+	default:
+		from = record->capture;
+		to = record->presented;
+		break;
+	}
+
+	return to > from ? to - from : 0;
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t
+next_random(struct latency_ctx *ctx)
+{
+	uint64_t x = ctx->random;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return ctx->random = x;
+}
@@ -0,0 +1,73 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct latency_ctx;
+
+/* times of one frame, CLOCK_MONOTONIC [ns] */
+struct latency_record {
+	uint32_t	sequence;		/* V4L2 frame counter */
+	uint64_t	capture;		/* V4L2 timestamp */
+	uint64_t	convert_start;
+	uint64_t	convert_end;
+	uint64_t	commit;			/* wl_surface_commit() */
+	uint64_t	presented;		/* wp_presentation feedback */
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct latency_ctx *latency_init(FILE *log);
+void latency_terminate(struct latency_ctx *ctx);
+
+bool latency_begin(struct latency_ctx *ctx, const struct latency_record *record);
+void latency_end(struct latency_ctx *ctx, uint32_t sequence, uint64_t commit, uint64_t presented);
+
+void latency_report(struct latency_ctx *ctx, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _LATENCY_H */
@@ -30,13 +30,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
 
 #include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 
 #include "common.h"
 #include "camera.h"
-#include "wayland.h"
+#include "sink.h"
 #include "convert.h"
+#include "worker.h"
+#include "format.h"
+#include "mjpeg.h"
+#include "event.h"
+#include "ring.h"
+#include "latency.h"
+#include "damage.h"
+#include "drops.h"
+#include "probe.h"
+#include "trace.h"
 #include "util.h"
 
 
@@ -45,12 +63,111 @@
 ======================================*/
 
 #define DEFAULT_DEVICE_NAME		"/dev/video0"
+#define DEFAULT_SINK_NAME		"wayland"
+
+#define SLOT_MAX		8	/* as many buffers as a sink cycles */
+#define CAMERA_BUFFERS_MAX	32
+#define PROBE_PERIOD		5000	/* [ms] between stage reports */
+#define TRACE_EVENTS		65536	/* the newest are kept, about 9000 frames */
+
+#define DEFAULT_TILE_THRESHOLD	6	/* per sample, above sensor noise */
+
+/* what the capture thread does when every slot is waiting to be shown */
+enum overflow {
+	OVERFLOW_DROP_OLDEST = 0,	/* reuse the oldest unshown slot */
+	OVERFLOW_BLOCK					/* wait, every frame is shown */
+};
+
+
+/*======================================
+	Structure
+======================================*/
+
+/* an acquired wl_shm buffer, filled by whoever converts */
+struct slot {
+	void		   *data;
+	unsigned int	width, height;
+	bool			out;		/* handed to the capture thread, Wayland thread only */
+
+	struct latency_record	record;	/* of the frame in it */
+	uint8_t				   *damage;	/* tiles changed since the last commit, tile diff only */
+};
+
+struct pipeline {
+	struct camera_ctx	   *camera_ctx;
+	struct worker_ctx	   *worker_ctx;
+	struct sink_ctx	   *sink_ctx;
+	struct mjpeg_ctx	   *mjpeg_ctx;		/* MJPEG capture only */
+	struct event_ctx	   *event_ctx;
+
+	struct convert_scaler  *scaler;		/* window size != camera size */
+	enum convert_scale		scale_mode;
+
+	bool					camera_parked;	/* no free wl_shm buffer to fill */
+	bool					mailbox;		/* convert the newest frame only */
+	bool					quiet;
+
+	unsigned long			frames_max;		/* stop after as many presents, 0 : never */
+	unsigned long			presented;
+
+	struct latency_ctx	   *latency_ctx;	/* Wayland thread, NULL when not measured */
+	struct drops_ctx	   *drops_ctx;		/* NULL when not accounted */
+	struct probe_ctx	   *probe_ctx;		/* stage times, NULL when quiet */
+	struct trace_ctx	   *trace_ctx;		/* per-frame events, NULL when not traced */
+
+	struct damage_ctx	   *damage_ctx;		/* capture side, NULL : convert whole frames */
+	uint32_t				tile;
+	uint32_t				tiles_x, tiles_y;
+	unsigned int			tiles_nr;
+	atomic_uint				damage_lost;	/* presents to damage whole, a frame was stolen */
+
+	struct slot				slots[SLOT_MAX];
+	unsigned int			slots_nr;
+	struct slot			   *slot;		/* being filled */
+
+	/* capture thread only */
+	bool					threaded;
+	enum overflow			overflow;
+	pthread_t				capture_thread;
+	struct event_ctx	   *capture_event_ctx;
+	struct ring_ctx		   *free_ring;	/* acquired slots, Wayland -> capture */
+	struct ring_ctx		   *ready_ring;	/* converted slots, capture -> Wayland */
+	int						quit_fd;	/* Wayland -> capture */
+	int						done_fd;	/* capture -> Wayland, the thread stopped */
+};
 
 
 /*======================================
 	Prototype
 ======================================*/
 
+static bool handle_camera(void *arg, int fd, uint32_t events);
+static bool handle_display(void *arg, int fd, uint32_t events);
+static void handle_feedback(void *arg, uint32_t tag, uint64_t commit, uint64_t presented);
+static void handle_release(void *arg, uint32_t tag, uint64_t commit, uint64_t released);
+static bool present_slot(struct pipeline *pipeline, struct slot *slot);
+
+static bool start_capture_thread(struct pipeline *pipeline);
+static void stop_capture_thread(struct pipeline *pipeline);
+static void *capture_main(void *arg);
+static bool handle_capture(void *arg, int fd, uint32_t events);
+static bool handle_free(void *arg, int fd, uint32_t events);
+static bool handle_ready(void *arg, int fd, uint32_t events);
+static bool handle_stop(void *arg, int fd, uint32_t events);
+static bool handle_trace(void *arg, int fd, uint32_t events);
+static int open_trace_signal(void);
+static struct slot *take_slot(struct pipeline *pipeline);
+static bool feed_slots(struct pipeline *pipeline);
+
+static int capture_frame(struct pipeline *pipeline, struct slot *slot);
+static int convert_frame(struct pipeline *pipeline, struct slot *slot, struct camera_frame *frame);
+static bool convert_tiles(struct pipeline *pipeline, struct slot *slot, struct camera_frame *frame,
+	uint32_t src_format, uint32_t dst_format);
+static bool init_tiles(struct pipeline *pipeline, uint32_t tile, unsigned int threshold);
+static void terminate_tiles(struct pipeline *pipeline);
+static int damage_to_rects(struct pipeline *pipeline, struct slot *slot, struct sink_rect *rects,
+	unsigned int max);
+static void show_queue_stats(struct camera_ctx *camera_ctx);
 static void usage(FILE *fp, int argc, char *argv[]);
 
 
@@ -61,22 +178,52 @@ static void usage(FILE *fp, int argc, char *argv[]);
 int
 main(int argc, char *argv[])
 {
-	static const char short_options[] = "d:qh";
+	static const char short_options[] = "d:S:F:f:P:B:o:n:t:s:c:b:L:r:T:N:Mmqh";
 	static const struct option long_options[] = {
 		{ "device",	required_argument,	NULL, 'd' },
+		{ "size",	required_argument,	NULL, 'S' },
+		{ "format",	required_argument,	NULL, 'F' },
+		{ "fps",	required_argument,	NULL, 'f' },
+		{ "prefer",	required_argument,	NULL, 'P' },
+		{ "camera-buffers",	required_argument,	NULL, 'B' },
+		{ "output",	required_argument,	NULL, 'o' },
+		{ "frames",	required_argument,	NULL, 'n' },
+		{ "convert-threads",	required_argument,	NULL, 't' },
+		{ "scale",	required_argument,	NULL, 's' },
+		{ "capture-thread",	required_argument,	NULL, 'c' },
+		{ "buffers",	required_argument,	NULL, 'b' },
+		{ "latency-log",	required_argument,	NULL, 'L' },
+		{ "trace",	required_argument,	NULL, 'r' },
+		{ "tiles",	required_argument,	NULL, 'T' },
+		{ "tile-threshold",	required_argument,	NULL, 'N' },
+		{ "mailbox",	no_argument,		NULL, 'M' },
+		{ "mjpeg",	no_argument,		NULL, 'm' },
 		{ "quiet",  no_argument,		NULL, 'q' },
 		{ "help",	no_argument,		NULL, 'h' },
 		{ 0, 0, 0, 0 }
 	};
 
+	struct pipeline pipeline = { 0 };
+	struct camera_config camera_config = { 0 };
+	const char *sink_name = DEFAULT_SINK_NAME;
 	struct camera_ctx *camera_ctx;
-	struct wayland_ctx *wayland_ctx;
-	char *dev_name;
-	unsigned char *buff, *converted;
-	bool ret;
+	struct sink_ctx *sink_ctx;
+	struct worker_ctx *worker_ctx;
+	struct event_ctx *event_ctx;
+	unsigned int threads = 1;
+	uint32_t sources[8], formats[2];
+	unsigned int sources_nr;
+	bool prefer_mjpeg = false;
 	bool quiet = false;
+	bool display_writable = false;
+	FILE *latency_log = NULL;
+	const char *trace_path = NULL;
+	int trace_fd = -1;
+	uint32_t tile = 0;
+	unsigned int tile_threshold = DEFAULT_TILE_THRESHOLD;
 
-	dev_name = DEFAULT_DEVICE_NAME;
+	camera_config.name = DEFAULT_DEVICE_NAME;
+	camera_config.fps = -1;
 
 	do {
 		int idx;
@@ -93,7 +240,131 @@ main(int argc, char *argv[])
 			break;
 
 		case 'd':
-			dev_name = optarg;
+			camera_config.name = optarg;
+			break;
+
+		case 'S':
+			if (sscanf(optarg, "%ux%u", &camera_config.width, &camera_config.height) != 2) {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'F':
+			camera_config.format = format_from_name(optarg);
+			if (!camera_config.format) {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'f':
+			camera_config.fps = strtol(optarg, NULL, 0);
+			if (camera_config.fps < 0) {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'P':
+			if (strcmp(optarg, "size") == 0) {
+				camera_config.prefer = CAMERA_PREFER_SIZE;
+			} else if (strcmp(optarg, "fps") == 0) {
+				camera_config.prefer = CAMERA_PREFER_FPS;
+			} else {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'B':
+			camera_config.buffers_max = 0;
+			if (sscanf(optarg, "%u-%u", &camera_config.buffers, &camera_config.buffers_max) < 1
+				|| camera_config.buffers < 2 || camera_config.buffers > CAMERA_BUFFERS_MAX
+				|| camera_config.buffers_max > CAMERA_BUFFERS_MAX
+				|| (camera_config.buffers_max && camera_config.buffers_max < camera_config.buffers)) {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'o':
+			sink_name = optarg;
+			break;
+
+		case 'n':
+			pipeline.frames_max = strtoul(optarg, NULL, 0);
+			break;
+
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+
+		case 's':
+			if (strcmp(optarg, "box") == 0) {
+				pipeline.scale_mode = CONVERT_SCALE_BOX;
+			} else if (strcmp(optarg, "bilinear") == 0) {
+				pipeline.scale_mode = CONVERT_SCALE_BILINEAR;
+			} else {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'c':
+			pipeline.threaded = true;
+			if (strcmp(optarg, "drop-oldest") == 0) {
+				pipeline.overflow = OVERFLOW_DROP_OLDEST;
+			} else if (strcmp(optarg, "block") == 0) {
+				pipeline.overflow = OVERFLOW_BLOCK;
+			} else {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'b':
+			pipeline.slots_nr = strtoul(optarg, NULL, 0);
+			if (pipeline.slots_nr < 2 || pipeline.slots_nr > SLOT_MAX) {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'L':
+			latency_log = fopen(optarg, "w");
+			if (!latency_log) {
+				LOG_ERROR("Cannot open '%s' : %d, %s", optarg, errno, strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'r':
+			trace_path = optarg;
+			break;
+
+		case 'T':
+			tile = strtoul(optarg, NULL, 0);
+			if (tile != 16 && tile != 32) {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'N':
+			tile_threshold = strtoul(optarg, NULL, 0);
+			if (tile_threshold > 255) {
+				usage(stderr, argc, argv);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'M':
+			pipeline.mailbox = true;
+			break;
+
+		case 'm':
+			prefer_mjpeg = true;
 			break;
 
 		case 'q':
@@ -110,89 +381,211 @@ main(int argc, char *argv[])
 		}
 	} while (1);
 
-	camera_ctx = camera_init(dev_name);
-	if (!camera_ctx) {
-		exit(EXIT_FAILURE);
+	convert_init();
+	if (!quiet)
+		LOG_DEBUG("converter : %s", convert_impl_get_name(convert_get_impl()));
+
+	/* before any thread starts, so that none of them takes SIGUSR1 */
+	if (trace_path) {
+		pipeline.trace_ctx = trace_init(trace_path, TRACE_EVENTS);
+		trace_fd = pipeline.trace_ctx ? open_trace_signal() : -1;
+		if (trace_fd < 0) {
+			trace_terminate(pipeline.trace_ctx);
+			exit(EXIT_FAILURE);
+		}
+
+		trace_name_thread(pipeline.trace_ctx, "main");
 	}
 
-	if (!camera_start_capturing(camera_ctx)) {
-		camera_stop_capturing(camera_ctx);
-		camera_terminate(camera_ctx);
+	worker_ctx = worker_init(threads);
+	if (!worker_ctx) {
 		exit(EXIT_FAILURE);
 	}
 
-	buff = (unsigned char *)malloc(camera_get_frame_size(camera_ctx));
-	if (!buff) {
-		LOG_ERROR("Out of Memory");
+	/*
+	 * every format with a converter, cheapest first, then MJPEG : decoding
+	 * costs more but USB cameras only reach full frame rate at high
+	 * resolutions with it
+	 */
+	sources_nr = convert_get_sources(FORMAT_XRGB8888, sources, sizeof(sources) / sizeof(sources[0]) - 1);
+	if (prefer_mjpeg) {
+		memmove(&sources[1], &sources[0], sources_nr * sizeof(sources[0]));
+		sources[0] = FORMAT_MJPEG;
+	} else {
+		sources[sources_nr] = FORMAT_MJPEG;
+	}
+	sources_nr++;
 
-		camera_stop_capturing(camera_ctx);
-		camera_terminate(camera_ctx);
+	camera_ctx = camera_init(&camera_config, sources, sources_nr);
+	if (!camera_ctx) {
+		worker_terminate(worker_ctx);
 		exit(EXIT_FAILURE);
 	}
 
-	ret = camera_read_frame(camera_ctx, buff, camera_get_frame_size(camera_ctx));
-	if (!ret) {
-		free(buff);
+	convert_set_matrix(camera_get_matrix(camera_ctx));
+	if (!quiet)
+		LOG_DEBUG("colour matrix : %s", convert_matrix_get_name(convert_get_matrix()));
+
+	if (camera_get_format(camera_ctx) == FORMAT_MJPEG) {
+		pipeline.mjpeg_ctx = mjpeg_init();
+		if (!pipeline.mjpeg_ctx) {
+			camera_terminate(camera_ctx);
+			worker_terminate(worker_ctx);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (!camera_start_capturing(camera_ctx)) {
 		camera_stop_capturing(camera_ctx);
 		camera_terminate(camera_ctx);
+		mjpeg_terminate(pipeline.mjpeg_ctx);
+		worker_terminate(worker_ctx);
 		exit(EXIT_FAILURE);
 	}
 
-	converted = (unsigned char *)malloc(camera_get_width(camera_ctx) * camera_get_height(camera_ctx) * 4);
-	if (!converted) {
-		LOG_ERROR("Out of Memory");
+	/* hand the camera format straight to the compositor if it takes it */
+	formats[0] = camera_get_format(camera_ctx);
+	formats[1] = FORMAT_XRGB8888;
+
+	/* triple buffered, one more lets the capture thread convert ahead */
+	if (!pipeline.slots_nr)
+		pipeline.slots_nr = pipeline.threaded ? 4 : 3;
 
-		free(buff);
+	sink_ctx = sink_init(sink_name, camera_get_width(camera_ctx), camera_get_height(camera_ctx), formats, 2,
+			pipeline.slots_nr);
+	if (!sink_ctx) {
 		camera_stop_capturing(camera_ctx);
 		camera_terminate(camera_ctx);
+		mjpeg_terminate(pipeline.mjpeg_ctx);
+		worker_terminate(worker_ctx);
 		exit(EXIT_FAILURE);
 	}
 
-	ret = convert_yuyv_to_bgrx8888(converted, buff, camera_get_width(camera_ctx), camera_get_height(camera_ctx));
-	if (!ret) {
-		free(converted);
-		free(buff);
-		camera_stop_capturing(camera_ctx);
-		camera_terminate(camera_ctx);
-		exit(EXIT_FAILURE);
+	if (!quiet)
+		LOG_DEBUG("camera format : %s %ux%u at %.2f fps, %s format : %s",
+				format_get_name(camera_get_format(camera_ctx)),
+				camera_get_width(camera_ctx), camera_get_height(camera_ctx), camera_get_fps(camera_ctx),
+				sink_get_name(sink_ctx), format_get_name(sink_get_format(sink_ctx)));
+
+	pipeline.camera_ctx = camera_ctx;
+	pipeline.worker_ctx = worker_ctx;
+	pipeline.sink_ctx = sink_ctx;
+	pipeline.quiet = quiet;
+
+	/* YUYV only, compared as captured */
+	if (tile) {
+		if (camera_get_format(camera_ctx) != FORMAT_YUYV)
+			LOG_ERROR("tile diff needs YUYV capture, not %s", format_get_name(camera_get_format(camera_ctx)));
+
+		if (camera_get_format(camera_ctx) != FORMAT_YUYV || !init_tiles(&pipeline, tile, tile_threshold)) {
+			mjpeg_terminate(pipeline.mjpeg_ctx);
+			sink_terminate(sink_ctx);
+			camera_stop_capturing(camera_ctx);
+			camera_terminate(camera_ctx);
+			worker_terminate(worker_ctx);
+			exit(EXIT_FAILURE);
+		}
 	}
 
-	wayland_ctx = wayland_init(camera_get_width(camera_ctx), camera_get_height(camera_ctx));
-	if (!wayland_ctx) {
-		free(converted);
-		free(buff);
+	/* frames lost on the way to the screen, and the spacing of the captures */
+	if (!quiet)
+		pipeline.drops_ctx = drops_init();
+
+	/* where the time goes, reported every period */
+	if (!quiet)
+		pipeline.probe_ctx = probe_init(PROBE_PERIOD, stdout);
+
+	/* capture-to-glass latency of every frame */
+	if (!quiet || latency_log)
+		pipeline.latency_ctx = latency_init(latency_log);
+
+	/* what was shown and when, where the compositor tells */
+	if ((pipeline.latency_ctx || pipeline.drops_ctx || pipeline.trace_ctx)
+		&& sink_set_feedback(sink_ctx, handle_feedback, &pipeline)) {
+		drops_set_feedback(pipeline.drops_ctx);
+	} else {
+		latency_terminate(pipeline.latency_ctx);
+		pipeline.latency_ctx = NULL;
+	}
+
+	/* how long the output holds on to a committed buffer */
+	if (pipeline.probe_ctx || pipeline.trace_ctx)
+		sink_set_release(sink_ctx, handle_release, &pipeline);
+
+	/* one loop for both, each serviced only when its fd is ready */
+	event_ctx = event_init();
+	pipeline.event_ctx = event_ctx;
+	if (!event_ctx
+		|| !event_add(event_ctx, sink_get_fd(sink_ctx), EPOLLIN, handle_display, &pipeline)
+		|| (trace_fd >= 0 && !event_add(event_ctx, trace_fd, EPOLLIN, handle_trace, &pipeline))
+		|| (pipeline.threaded ? !start_capture_thread(&pipeline)
+			: !event_add(event_ctx, camera_get_fd(camera_ctx), EPOLLIN, handle_camera, &pipeline))) {
+		event_terminate(event_ctx);
+		terminate_tiles(&pipeline);
+		sink_terminate(sink_ctx);
 		camera_stop_capturing(camera_ctx);
 		camera_terminate(camera_ctx);
+		mjpeg_terminate(pipeline.mjpeg_ctx);
+		worker_terminate(worker_ctx);
 		exit(EXIT_FAILURE);
 	}
 
-	while (wayland_is_running()) {
-		if (!quiet)
-			util_show_fps();
+	while (sink_is_running(sink_ctx)
+		&& (!pipeline.frames_max || pipeline.presented < pipeline.frames_max)) {
+		int ret;
 
-		if (wayland_queue_buffer(wayland_ctx, converted)) {
-
-			ret = camera_read_frame(camera_ctx, buff, camera_get_frame_size(camera_ctx));
-			if (!ret)
-				break;
+		if (!sink_prepare_read(sink_ctx))
+			break;
 
-			ret =  convert_yuyv_to_bgrx8888(converted, buff, camera_get_width(camera_ctx), camera_get_height(camera_ctx));
-			if (!ret)
+		/* what the socket had no room for goes out once it polls writable */
+		if (sink_needs_writable(sink_ctx) != display_writable) {
+			display_writable = !display_writable;
+			if (!event_modify(event_ctx, sink_get_fd(sink_ctx),
+					display_writable ? EPOLLIN | EPOLLOUT : EPOLLIN))
 				break;
 		}
 
-		if (wayland_dispatch_event(wayland_ctx) < 0)
+		ret = event_dispatch(event_ctx, -1);
+
+		/* no-op when handle_display() read the events */
+		sink_cancel_read(sink_ctx);
+
+		if (ret < 0)
 			break;
 	}
 
-	wayland_terminate(wayland_ctx);
+	if (pipeline.threaded)
+		stop_capture_thread(&pipeline);
 
-	free(converted);
-	free(buff);
+	event_terminate(event_ctx);
+
+	if (!quiet)
+		latency_report(pipeline.latency_ctx, stdout);
+	if (!quiet)
+		show_queue_stats(camera_ctx);
+	drops_report(pipeline.drops_ctx, camera_get_fps(camera_ctx), stdout);
+	latency_terminate(pipeline.latency_ctx);
+	drops_terminate(pipeline.drops_ctx);
+	probe_terminate(pipeline.probe_ctx);
+
+	trace_flush(pipeline.trace_ctx);
+	trace_terminate(pipeline.trace_ctx);
+	if (trace_fd >= 0)
+		close(trace_fd);
+	if (latency_log)
+		fclose(latency_log);
+
+	convert_scaler_destroy(pipeline.scaler);
+	terminate_tiles(&pipeline);
+
+	sink_terminate(sink_ctx);
 
 	camera_stop_capturing(camera_ctx);
 	camera_terminate(camera_ctx);
 
+	mjpeg_terminate(pipeline.mjpeg_ctx);
+	worker_terminate(worker_ctx);
+
 	return 0;
 }
 
@@ -200,6 +593,668 @@ main(int argc, char *argv[])
 	Inner function
 ======================================*/
 
+static bool
+handle_camera(void *arg, int fd, uint32_t events)
+{
+	struct pipeline *pipeline = arg;
+	struct slot *slot;
+	int ret;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		LOG_ERROR("camera fd error, events 0x%x", events);
+		return false;
+	}
+
+	/* convert straight from the V4L2 buffer into a free wl_shm buffer */
+	if (!pipeline->slot) {
+		slot = &pipeline->slots[0];
+
+		/* one frame in flight at a time */
+		if (!sink_is_presenting(pipeline->sink_ctx))
+			slot->data = sink_acquire_buffer(pipeline->sink_ctx, &slot->width, &slot->height);
+		else
+			slot->data = NULL;
+
+		if (!slot->data) {
+			/* the frame waits in the driver until the compositor frees a buffer */
+			pipeline->camera_parked = true;
+			return event_modify(pipeline->event_ctx, fd, 0);
+		}
+
+		pipeline->slot = slot;
+	}
+
+	ret = capture_frame(pipeline, pipeline->slot);
+	if (ret < 0)
+		return false;
+
+	/* dropped, the wl_shm buffer stays acquired for the next frame */
+	if (ret == 0)
+		return true;
+
+	if (!present_slot(pipeline, pipeline->slot))
+		return false;
+
+	pipeline->slot = NULL;
+
+	probe_frame(pipeline->probe_ctx);
+
+	return true;
+}
+
+static bool
+handle_display(void *arg, int fd, uint32_t events)
+{
+	struct pipeline *pipeline = arg;
+
+	/* writable only, the next sink_prepare_read() flushes */
+	if (!(events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+		return true;
+
+	if (!sink_read_events(pipeline->sink_ctx))
+		return false;
+
+	if (pipeline->threaded)
+		return feed_slots(pipeline);
+
+	/* a release or frame callback may have freed a buffer */
+	if (pipeline->camera_parked) {
+		pipeline->camera_parked = false;
+		return event_modify(pipeline->event_ctx, camera_get_fd(pipeline->camera_ctx), EPOLLIN);
+	}
+
+	return true;
+}
+
+/* wp_presentation feedback, tagged with the V4L2 sequence */
+static void
+handle_feedback(void *arg, uint32_t tag, uint64_t commit, uint64_t presented)
+{
+	struct pipeline *pipeline = arg;
+
+	latency_end(pipeline->latency_ctx, tag, commit, presented);
+
+	if (presented) {
+		drops_shown(pipeline->drops_ctx);
+		trace_add(pipeline->trace_ctx, TRACE_PRESENT, tag, commit, presented);
+	} else {
+		drops_add(pipeline->drops_ctx, DROP_DISCARDED, 1);
+	}
+}
+
+/* the output gave a committed buffer back */
+static void
+handle_release(void *arg, uint32_t tag, uint64_t commit, uint64_t released)
+{
+	struct pipeline *pipeline = arg;
+
+	probe_add(pipeline->probe_ctx, PROBE_RELEASE, commit, released);
+	trace_add(pipeline->trace_ctx, TRACE_RELEASE, tag, commit, released);
+}
+
+/* Wayland thread */
+static bool
+present_slot(struct pipeline *pipeline, struct slot *slot)
+{
+	struct sink_rect rects[SINK_RECT_MAX];
+	unsigned int lost;
+	int rects_nr = -1;
+	uint64_t start = 0;
+	bool ret;
+
+	pipeline->presented++;
+
+	if (pipeline->probe_ctx || pipeline->trace_ctx) {
+		start = util_get_time();
+		probe_add(pipeline->probe_ctx, PROBE_HANDOFF, slot->record.convert_end, start);
+		trace_add(pipeline->trace_ctx, TRACE_HANDOFF, slot->record.sequence, slot->record.convert_end, start);
+	}
+
+	if (pipeline->latency_ctx)
+		latency_begin(pipeline->latency_ctx, &slot->record);
+
+	if (slot->damage) {
+		/* whole when a frame was stolen or scaled, the tiles are of the camera frame */
+		lost = atomic_load(&pipeline->damage_lost);
+		if (lost)
+			atomic_compare_exchange_strong(&pipeline->damage_lost, &lost, lost - 1);
+		else if (slot->width == camera_get_width(pipeline->camera_ctx)
+			&& slot->height == camera_get_height(pipeline->camera_ctx))
+			rects_nr = damage_to_rects(pipeline, slot, rects, SINK_RECT_MAX);
+
+		memset(slot->damage, 0, pipeline->tiles_nr);
+	}
+
+	ret = sink_present_buffer(pipeline->sink_ctx, slot->data, slot->record.sequence,
+			rects_nr < 0 ? NULL : rects, rects_nr < 0 ? 0 : rects_nr);
+
+	if (pipeline->probe_ctx || pipeline->trace_ctx) {
+		uint64_t end = util_get_time();
+
+		probe_add(pipeline->probe_ctx, PROBE_COMMIT, start, end);
+		trace_add(pipeline->trace_ctx, TRACE_COMMIT, slot->record.sequence, start, end);
+	}
+
+	return ret;
+}
+
+/*
+ * The capture thread owns the camera and every conversion state, it fills
+ * slots from 'free_ring' and hands them back through 'ready_ring'. The
+ * Wayland thread only acquires, attaches and commits the buffers.
+ */
+static bool
+start_capture_thread(struct pipeline *pipeline)
+{
+	int ret;
+
+	pipeline->quit_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	pipeline->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (pipeline->quit_fd < 0 || pipeline->done_fd < 0) {
+		LOG_PERROR("eventfd");
+		return false;
+	}
+
+	pipeline->free_ring = ring_init(pipeline->slots_nr);
+	pipeline->ready_ring = ring_init(pipeline->slots_nr);
+	pipeline->capture_event_ctx = event_init();
+	if (!pipeline->free_ring || !pipeline->ready_ring || !pipeline->capture_event_ctx)
+		return false;
+
+	if (!event_add(pipeline->capture_event_ctx, camera_get_fd(pipeline->camera_ctx), EPOLLIN,
+			handle_capture, pipeline)
+		|| !event_add(pipeline->capture_event_ctx, ring_get_fd(pipeline->free_ring), EPOLLIN,
+			handle_free, pipeline)
+		|| !event_add(pipeline->capture_event_ctx, pipeline->quit_fd, EPOLLIN, handle_stop, pipeline))
+		return false;
+
+	if (!event_add(pipeline->event_ctx, ring_get_fd(pipeline->ready_ring), EPOLLIN, handle_ready, pipeline)
+		|| !event_add(pipeline->event_ctx, pipeline->done_fd, EPOLLIN, handle_stop, pipeline))
+		return false;
+
+	if (!feed_slots(pipeline))
+		return false;
+
+	ret = pthread_create(&pipeline->capture_thread, NULL, capture_main, pipeline);
+	if (ret != 0) {
+		LOG_ERROR("pthread_create error %d, %s", ret, strerror(ret));
+		return false;
+	}
+
+	return true;
+}
+
+static void
+stop_capture_thread(struct pipeline *pipeline)
+{
+	uint64_t one = 1;
+
+	if (write(pipeline->quit_fd, &one, sizeof(one)) < 0)
+		LOG_PERROR("write");
+
+	pthread_join(pipeline->capture_thread, NULL);
+
+	event_terminate(pipeline->capture_event_ctx);
+	ring_terminate(pipeline->free_ring);
+	ring_terminate(pipeline->ready_ring);
+	close(pipeline->quit_fd);
+	close(pipeline->done_fd);
+}
+
+static void *
+capture_main(void *arg)
+{
+	struct pipeline *pipeline = arg;
+	uint64_t one = 1;
+
+	trace_name_thread(pipeline->trace_ctx, "capture");
+
+	while (event_dispatch(pipeline->capture_event_ctx, -1) >= 0)
+		;
+
+	/* quit or failed, either way the Wayland thread stops too */
+	if (write(pipeline->done_fd, &one, sizeof(one)) < 0)
+		LOG_PERROR("write");
+
+	return NULL;
+}
+
+static bool
+handle_capture(void *arg, int fd, uint32_t events)
+{
+	struct pipeline *pipeline = arg;
+	int ret;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		LOG_ERROR("camera fd error, events 0x%x", events);
+		return false;
+	}
+
+	if (!pipeline->slot)
+		pipeline->slot = take_slot(pipeline);
+
+	if (!pipeline->slot) {
+		/* wait in handle_free() for the Wayland thread to hand one over */
+		pipeline->camera_parked = true;
+		return event_modify(pipeline->capture_event_ctx, fd, 0);
+	}
+
+	ret = capture_frame(pipeline, pipeline->slot);
+	if (ret < 0)
+		return false;
+
+	/* dropped, the slot is kept for the next frame */
+	if (ret == 0)
+		return true;
+
+	/* as many entries as slots, never full */
+	ring_push(pipeline->ready_ring, pipeline->slot);
+	pipeline->slot = NULL;
+
+	probe_frame(pipeline->probe_ctx);
+
+	return true;
+}
+
+static bool
+handle_free(void *arg, int fd, uint32_t events)
+{
+	struct pipeline *pipeline = arg;
+
+	ring_ack(pipeline->free_ring);
+
+	if (pipeline->camera_parked) {
+		pipeline->camera_parked = false;
+		return event_modify(pipeline->capture_event_ctx, camera_get_fd(pipeline->camera_ctx), EPOLLIN);
+	}
+
+	return true;
+}
+
+static bool
+handle_ready(void *arg, int fd, uint32_t events)
+{
+	struct pipeline *pipeline = arg;
+
+	ring_ack(pipeline->ready_ring);
+
+	return feed_slots(pipeline);
+}
+
+/* quit_fd for the capture thread, done_fd for the Wayland thread */
+static bool
+handle_stop(void *arg, int fd, uint32_t events)
+{
+	return false;
+}
+
+/* SIGUSR1 : the trace so far is written out, recording goes on */
+static bool
+handle_trace(void *arg, int fd, uint32_t events)
+{
+	struct pipeline *pipeline = arg;
+	struct signalfd_siginfo info;
+
+	while (read(fd, &info, sizeof(info)) == sizeof(info))
+		;
+
+	trace_flush(pipeline->trace_ctx);
+
+	return true;
+}
+
+/* SIGUSR1 through an fd, blocked for the calling thread and those it starts */
+static int
+open_trace_signal(void)
+{
+	sigset_t mask;
+	int ret, fd;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+
+	ret = pthread_sigmask(SIG_BLOCK, &mask, NULL);
+	if (ret != 0) {
+		LOG_ERROR("pthread_sigmask error %d, %s", ret, strerror(ret));
+		return -1;
+	}
+
+	fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (fd < 0)
+		LOG_PERROR("signalfd");
+
+	return fd;
+}
+
+/* capture thread */
+static struct slot *
+take_slot(struct pipeline *pipeline)
+{
+	struct slot *slot;
+
+	slot = ring_pop(pipeline->free_ring);
+	if (slot || pipeline->overflow != OVERFLOW_DROP_OLDEST)
+		return slot;
+
+	/*
+	 * the compositor is behind, overwrite the oldest frame it has not taken.
+	 * Its tiles are missing from the damage of the frames after it, the next
+	 * two presents damage the whole buffer : one may be of a slot popped just
+	 * before ours, the other is the first popped after.
+	 */
+	if (pipeline->damage_ctx)
+		atomic_store(&pipeline->damage_lost, 2);
+
+	/* the producer of the ready ring pops from it too, racing the Wayland thread */
+	slot = ring_pop(pipeline->ready_ring);
+	if (slot)
+		drops_add(pipeline->drops_ctx, DROP_OVERWRITTEN, 1);
+
+	return slot;
+}
+
+/* Wayland thread : present the next frame and hand every free buffer over, false when presenting failed */
+static bool
+feed_slots(struct pipeline *pipeline)
+{
+	struct sink_ctx *sink_ctx = pipeline->sink_ctx;
+	struct slot *slot, *next;
+	unsigned int i;
+	void *data;
+
+	/* the frame callback paces presentation */
+	if (!sink_is_presenting(sink_ctx)) {
+		slot = ring_pop(pipeline->ready_ring);
+
+		/* skip to the newest, the older ones go back to be refilled */
+		while (slot && pipeline->overflow == OVERFLOW_DROP_OLDEST
+			&& (next = ring_pop(pipeline->ready_ring)) != NULL) {
+			/* its changes are shown with the newer frame */
+			if (slot->damage) {
+				for (i = 0; i < pipeline->tiles_nr; i++)
+					next->damage[i] |= slot->damage[i];
+				memset(slot->damage, 0, pipeline->tiles_nr);
+			}
+
+			ring_push(pipeline->free_ring, slot);
+			drops_add(pipeline->drops_ctx, DROP_SKIPPED, 1);
+			slot = next;
+		}
+
+		if (slot) {
+			if (!present_slot(pipeline, slot))
+				return false;
+			slot->out = false;
+		}
+	}
+
+	for (i = 0; i < pipeline->slots_nr; i++) {
+		slot = &pipeline->slots[i];
+		if (slot->out)
+			continue;
+
+		data = sink_acquire_buffer(sink_ctx, &slot->width, &slot->height);
+		if (!data)
+			break;
+
+		slot->data = data;
+		slot->out = true;
+		ring_push(pipeline->free_ring, slot);
+	}
+
+	return true;
+}
+
+/* 1 : converted, 0 : frame dropped, -1 : error */
+static int
+capture_frame(struct pipeline *pipeline, struct slot *slot)
+{
+	struct camera_ctx *camera_ctx = pipeline->camera_ctx;
+	struct camera_frame frame;
+	unsigned int skipped = 0;
+	int ret;
+
+	if (pipeline->mailbox) {
+		if (!camera_acquire_latest_frame(camera_ctx, &frame, &skipped))
+			return -1;
+
+		drops_add(pipeline->drops_ctx, DROP_MAILBOX, skipped);
+	} else {
+		if (!camera_acquire_frame(camera_ctx, &frame))
+			return -1;
+	}
+
+	drops_capture(pipeline->drops_ctx, frame.sequence, frame.timestamp, frame.lost, frame.error);
+
+	if (frame.bytesused < camera_get_frame_size(camera_ctx)) {
+		/* short frame, keep the slot for the next one */
+		LOG_ERROR("bytesused(%u) < frame size(%u)", frame.bytesused, camera_get_frame_size(camera_ctx));
+		drops_add(pipeline->drops_ctx, DROP_SHORT, 1);
+		return camera_release_frame(camera_ctx, &frame) ? 0 : -1;
+	}
+
+	slot->record.sequence = frame.sequence;
+	slot->record.capture = frame.timestamp;
+	slot->record.convert_start = util_get_time();
+
+	ret = convert_frame(pipeline, slot, &frame);
+
+	slot->record.convert_end = util_get_time();
+
+	if (!camera_release_frame(camera_ctx, &frame))
+		return -1;
+
+	/* the frame waited in the driver queue until it was dequeued */
+	if (pipeline->probe_ctx || pipeline->trace_ctx) {
+		struct latency_record *record = &slot->record;
+		bool copy = camera_get_format(camera_ctx) == sink_get_format(pipeline->sink_ctx);
+		uint64_t requeued = util_get_time();
+
+		probe_add(pipeline->probe_ctx, PROBE_DEQUEUE, record->capture, record->convert_start);
+		probe_add(pipeline->probe_ctx, copy ? PROBE_COPY : PROBE_CONVERT, record->convert_start, record->convert_end);
+		probe_add(pipeline->probe_ctx, PROBE_REQUEUE, record->convert_end, requeued);
+
+		trace_add(pipeline->trace_ctx, TRACE_DEQUEUE, record->sequence, record->capture, record->convert_start);
+		trace_add(pipeline->trace_ctx, copy ? TRACE_COPY : TRACE_CONVERT, record->sequence,
+				record->convert_start, record->convert_end);
+		trace_add(pipeline->trace_ctx, TRACE_REQUEUE, record->sequence, record->convert_end, requeued);
+	}
+
+	return ret;
+}
+
+/* 1 : converted, 0 : frame dropped, -1 : error */
+static int
+convert_frame(struct pipeline *pipeline, struct slot *slot, struct camera_frame *frame)
+{
+	struct camera_ctx *camera_ctx = pipeline->camera_ctx;
+	void *dst = slot->data;
+	uint32_t src_format, dst_format;
+	uint32_t src_width, src_height, dst_width, dst_height;
+
+	src_format	= camera_get_format(camera_ctx);
+	dst_format	= sink_get_format(pipeline->sink_ctx);	/* fixed at init */
+	src_width	= camera_get_width(camera_ctx);
+	src_height	= camera_get_height(camera_ctx);
+	dst_width	= slot->width;
+	dst_height	= slot->height;
+
+	/* decoded straight into the window, DCT-scaled when it is smaller */
+	if (src_format == FORMAT_MJPEG) {
+		if (!mjpeg_decode(pipeline->mjpeg_ctx, dst, dst_width, dst_height, frame->data, frame->bytesused)) {
+			LOG_ERROR("dropping undecodable frame %u", frame->sequence);
+			return 0;
+		}
+
+		return 1;
+	}
+
+	/* only the tiles that changed, into a buffer that may be a few frames behind */
+	if (pipeline->damage_ctx) {
+		if (src_width == dst_width && src_height == dst_height)
+			return convert_tiles(pipeline, slot, frame, src_format, dst_format) ? 1 : -1;
+
+		/* scaled, every pixel changes and the tile state no longer holds */
+		damage_reset(pipeline->damage_ctx);
+		memset(slot->damage, 1, pipeline->tiles_nr);
+	}
+
+	/* same format is a pass-through copy, the compositor converts while compositing */
+	if (src_format == dst_format || (src_width == dst_width && src_height == dst_height))
+		return convert_run(pipeline->worker_ctx, src_format, dst_format, dst, frame->data,
+				src_width, src_height) ? 1 : -1;
+
+	/* window resized : scale and convert in one pass to the shown size */
+	if (!convert_scaler_matches(pipeline->scaler, src_format, src_width, src_height, dst_width, dst_height)) {
+		convert_scaler_destroy(pipeline->scaler);
+
+		pipeline->scaler = convert_scaler_create(src_format, src_width, src_height,
+				dst_width, dst_height, pipeline->scale_mode);
+		if (!pipeline->scaler)
+			return -1;
+	}
+
+	return convert_scaler_run(pipeline->scaler, pipeline->worker_ctx, dst, frame->data) ? 1 : -1;
+}
+
+/*
+ * The slot's buffer is brought up to date with the tiles it missed, which
+ * are more than this frame's dirty ones when other buffers were filled
+ * since. The compositor is only told about this frame's.
+ */
+static bool
+convert_tiles(struct pipeline *pipeline, struct slot *slot, struct camera_frame *frame,
+	uint32_t src_format, uint32_t dst_format)
+{
+	struct damage_ctx *damage_ctx = pipeline->damage_ctx;
+	const uint8_t *dirty, *stale;
+	unsigned int i;
+
+	if (damage_update(damage_ctx, frame->data)) {
+		dirty = damage_get_dirty(damage_ctx);
+		for (i = 0; i < pipeline->tiles_nr; i++)
+			slot->damage[i] |= dirty[i];
+	}
+
+	stale = damage_get_stale(damage_ctx, slot->data);
+	if (!convert_run_tiles(pipeline->worker_ctx, src_format, dst_format, slot->data, frame->data,
+			slot->width, slot->height, pipeline->tile, stale))
+		return false;
+
+	damage_clear_stale(damage_ctx, slot->data);
+
+	return true;
+}
+
+static bool
+init_tiles(struct pipeline *pipeline, uint32_t tile, unsigned int threshold)
+{
+	unsigned int i;
+
+	pipeline->damage_ctx = damage_init(camera_get_width(pipeline->camera_ctx),
+			camera_get_height(pipeline->camera_ctx), tile, threshold);
+	if (!pipeline->damage_ctx)
+		return false;
+
+	pipeline->tile = tile;
+	pipeline->tiles_nr = damage_get_tiles(pipeline->damage_ctx, &pipeline->tiles_x, &pipeline->tiles_y);
+
+	for (i = 0; i < SLOT_MAX; i++) {
+		pipeline->slots[i].damage = calloc(pipeline->tiles_nr, 1);
+		if (!pipeline->slots[i].damage) {
+			LOG_ERROR("Out of Memory");
+			terminate_tiles(pipeline);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+terminate_tiles(struct pipeline *pipeline)
+{
+	unsigned int i;
+
+	for (i = 0; i < SLOT_MAX; i++) {
+		free(pipeline->slots[i].damage);
+		pipeline->slots[i].damage = NULL;
+	}
+
+	damage_terminate(pipeline->damage_ctx);
+	pipeline->damage_ctx = NULL;
+}
+
+/*
+ * Runs of changed tiles on a tile row, grown downwards while the rows below
+ * have the same run. -1 when it takes more than 'max' rectangles.
+ */
+static int
+damage_to_rects(struct pipeline *pipeline, struct slot *slot, struct sink_rect *rects,
+	unsigned int max)
+{
+	const uint8_t *map = slot->damage;
+	uint32_t tile = pipeline->tile;
+	uint32_t tx, ty, end;
+	int32_t x, y, width, height;
+	unsigned int i, nr = 0;
+
+	for (ty = 0; ty < pipeline->tiles_y; ty++, map += pipeline->tiles_x) {
+		y = ty * tile;
+		height = (y + tile < slot->height ? y + tile : slot->height) - y;
+
+		for (tx = 0; tx < pipeline->tiles_x; tx = end) {
+			for (; tx < pipeline->tiles_x && !map[tx]; tx++)
+				;
+			for (end = tx; end < pipeline->tiles_x && map[end]; end++)
+				;
+			if (tx == end)
+				break;
+
+			x = tx * tile;
+			width = (end * tile < slot->width ? end * tile : slot->width) - x;
+
+			for (i = 0; i < nr; i++)
+				if (rects[i].y + rects[i].height == y && rects[i].x == x && rects[i].width == width)
+					break;
+
+			if (i < nr) {
+				rects[i].height += height;
+				continue;
+			}
+
+			if (nr == max)
+				return -1;
+
+			rects[nr].x			= x;
+			rects[nr].y			= y;
+			rects[nr].width		= width;
+			rects[nr].height	= height;
+			nr++;
+		}
+	}
+
+	return nr;
+}
+
+static void
+show_queue_stats(struct camera_ctx *camera_ctx)
+{
+	struct camera_queue_stats stats;
+
+	if (!camera_get_queue_stats(camera_ctx, &stats) || !stats.frames)
+		return;
+
+	LOG_DEBUG("camera queue : %u buffers after %u resizes, %" PRIu64 " frames",
+			stats.depth, stats.resizes, stats.frames);
+	if (!stats.samples)
+		return;
+
+	LOG_DEBUG("camera queue : %.2f buffers left to the driver (min %u), %.2f waiting (max %u)",
+			(double)stats.queued_sum / stats.samples, stats.queued_min,
+			(double)stats.done_sum / stats.samples, stats.done_max);
+}
+
 static void
 usage(FILE *fp, int argc, char *argv[])
 {
@@ -207,10 +1262,41 @@ usage(FILE *fp, int argc, char *argv[])
 		 "Usage: %s [options]\n\n"
 		 "Version 0.1\n"
 		 "Options:\n"
-		 "-d | --device name   Video device name [%s]\n"
+		 "-d | --device name   Video device name [%s], file:<path> to replay a raw\n"
+		 "                     or MJPEG dump or pattern for generated colour bars\n"
+		 "-S | --size WxH      Frame size of a file or pattern source [640x480],\n"
+		 "                     the minimum of a device\n"
+		 "-F | --format fourcc Capture format, YUYV for a file by default\n"
+		 "-f | --fps N         Frame rate of a file or pattern source, 0 for as\n"
+		 "                     fast as possible [30], the minimum of a device\n"
+		 "-P | --prefer what   Device mode with the highest fps or the largest size\n"
+		 "                     above the minimums [fps]\n"
+		 "-B | --camera-buffers N[-M]\n"
+		 "                     Queue N device buffers [4], with M adapt between N\n"
+		 "                     and M to the frames the driver loses, up to %d\n"
+		 "-o | --output name   Where frames go : wayland, or null[:fps] to drop them\n"
+		 "                     for benchmarks, paced to a fake vsync with fps [%s]\n"
+		 "-n | --frames N      Stop after N presented frames\n"
+		 "-t | --convert-threads N\n"
+		 "                     Convert in N row bands on a worker pool [1]\n"
+		 "-s | --scale mode    Scaling to the window size, box or bilinear [box]\n"
+		 "-c | --capture-thread policy\n"
+		 "                     Capture and convert on a thread of its own, when the\n"
+		 "                     compositor is behind drop-oldest frames or block\n"
+		 "-b | --buffers N     Cycle N output buffers, 2 to %d [3, 4 with a capture thread]\n"
+		 "-L | --latency-log file\n"
+		 "                     Write the times of every presented frame to file as CSV\n"
+		 "-r | --trace file    Record the stages of every frame, written to file as a\n"
+		 "                     Chrome JSON trace on exit and on SIGUSR1\n"
+		 "-T | --tiles N       Convert and damage only the NxN tiles that changed,\n"
+		 "                     N is 16 or 32, YUYV capture only\n"
+		 "-N | --tile-threshold T\n"
+		 "                     Mean change per sample a tile takes to be redrawn [%d]\n"
+		 "-M | --mailbox       Skip to the newest captured frame, drop the older ones\n"
+		 "-m | --mjpeg         Prefer MJPEG capture, decoded with libjpeg-turbo\n"
 		 "-q | --quiet         Quiet mode\n"
 		 "-h | --help	       Print this message\n"
 		 "",
-		 argv[0], DEFAULT_DEVICE_NAME);
+		 argv[0], DEFAULT_DEVICE_NAME, CAMERA_BUFFERS_MAX, DEFAULT_SINK_NAME, SLOT_MAX, DEFAULT_TILE_THRESHOLD);
 }
 
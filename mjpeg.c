@@ -0,0 +1,274 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+#include <jpeglib.h>
+
+#include "common.h"
+#include "mjpeg.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define MJPEG_BPP		4		/* XRGB8888 */
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct error_mgr {
+	struct jpeg_error_mgr	pub;
+	jmp_buf					jmp;
+};
+
+struct mjpeg_ctx {
+	struct jpeg_decompress_struct	cinfo;
+	struct error_mgr				err;
+
+	uint8_t		   *line;		/* rows that do not fit the destination */
+	size_t			line_size;
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static void error_exit(j_common_ptr cinfo);
+static void output_message(j_common_ptr cinfo);
+
+static unsigned int choose_scale(uint32_t width, uint32_t height, uint32_t dst_width, uint32_t dst_height);
+static bool reserve_line(struct mjpeg_ctx *ctx, size_t size);
+static void fill_border(uint8_t *dst, uint32_t dst_width, uint32_t dst_height,
+	uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+
+/*======================================
+	Public function
+======================================*/
+
+struct mjpeg_ctx *
+mjpeg_init(void)
+{
+	struct mjpeg_ctx *ctx;
+
+	ctx = (struct mjpeg_ctx *)calloc(1, sizeof(struct mjpeg_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->cinfo.err = jpeg_std_error(&ctx->err.pub);
+	ctx->err.pub.error_exit		= error_exit;
+	ctx->err.pub.output_message	= output_message;
+
+	if (setjmp(ctx->err.jmp)) {
+		free(ctx);
+		return NULL;
+	}
+
+	jpeg_create_decompress(&ctx->cinfo);
+
+	return ctx;
+}
+
+void
+mjpeg_terminate(struct mjpeg_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	jpeg_destroy_decompress(&ctx->cinfo);
+	free(ctx->line);
+	free(ctx);
+}
+
+/*
+ * Decodes a frame straight into an XRGB8888 buffer. The DCT-domain scaling
+ * of libjpeg picks the largest of 1, 1/2, 1/4 and 1/8 that fits the
+ * destination, so a small window skips most of the IDCT and colour work;
+ * the image is centred and the rest of the destination is black.
+ *
+ * A corrupt frame returns false, the destination is then incomplete.
+ */
+bool
+mjpeg_decode(struct mjpeg_ctx *ctx, void *dst, uint32_t dst_width, uint32_t dst_height,
+	const void *src, size_t size)
+{
+	struct jpeg_decompress_struct *cinfo;
+	size_t dst_stride = (size_t)dst_width * MJPEG_BPP;
+	size_t crop;
+	uint32_t x, y, width, height;
+
+	if (!ctx || !dst || !src || !size || !dst_width || !dst_height)
+		return false;
+
+	cinfo = &ctx->cinfo;
+
+	if (setjmp(ctx->err.jmp)) {
+		jpeg_abort_decompress(cinfo);
+		return false;
+	}
+
+	jpeg_mem_src(cinfo, (unsigned char *)src, size);
+
+	if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK) {
+		jpeg_abort_decompress(cinfo);
+		return false;
+	}
+
+	cinfo->out_color_space	= JCS_EXT_BGRX;
+	cinfo->scale_num		= 1;
+	cinfo->scale_denom		= choose_scale(cinfo->image_width, cinfo->image_height, dst_width, dst_height);
+
+	jpeg_start_decompress(cinfo);
+
+	width	= cinfo->output_width < dst_width ? cinfo->output_width : dst_width;
+	height	= cinfo->output_height < dst_height ? cinfo->output_height : dst_height;
+	x		= (dst_width - width) / 2;
+	y		= (dst_height - height) / 2;
+
+	/* wider than the destination even at 1/8 : decode through a line and crop */
+	if (cinfo->output_width > dst_width && !reserve_line(ctx, (size_t)cinfo->output_width * MJPEG_BPP)) {
+		jpeg_abort_decompress(cinfo);
+		return false;
+	}
+
+	/* left edge of the centred crop in the decoded line */
+	crop = (size_t)(cinfo->output_width - width) / 2 * MJPEG_BPP;
+
+	while (cinfo->output_scanline < height) {
+		uint8_t *row = (uint8_t *)dst + (y + cinfo->output_scanline) * dst_stride + x * MJPEG_BPP;
+
+		if (cinfo->output_width > dst_width) {
+			jpeg_read_scanlines(cinfo, &ctx->line, 1);
+			memcpy(row, ctx->line + crop, dst_stride);
+		} else {
+			jpeg_read_scanlines(cinfo, &row, 1);
+		}
+	}
+
+	/* taller than the destination : the remaining rows are not needed */
+	if (cinfo->output_scanline < cinfo->output_height)
+		jpeg_abort_decompress(cinfo);
+	else
+		jpeg_finish_decompress(cinfo);
+
+	fill_border(dst, dst_width, dst_height, x, y, width, height);
+
+	return true;
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+static void
+error_exit(j_common_ptr cinfo)
+{
+	struct error_mgr *err = (struct error_mgr *)cinfo->err;
+
+	(*cinfo->err->output_message)(cinfo);
+
+	longjmp(err->jmp, 1);
+}
+
+static void
+output_message(j_common_ptr cinfo)
+{
+	char buffer[JMSG_LENGTH_MAX];
+
+	(*cinfo->err->format_message)(cinfo, buffer);
+
+	LOG_ERROR("libjpeg : %s", buffer);
+}
+
+static unsigned int
+choose_scale(uint32_t width, uint32_t height, uint32_t dst_width, uint32_t dst_height)
+{
+	unsigned int denom;
+
+	for (denom = 1; denom < 8; denom *= 2)
+		if ((width + denom - 1) / denom <= dst_width && (height + denom - 1) / denom <= dst_height)
+			break;
+
+	return denom;
+}
+
+static bool
+reserve_line(struct mjpeg_ctx *ctx, size_t size)
+{
+	uint8_t *line;
+
+	if (ctx->line_size >= size)
+		return true;
+
+	line = realloc(ctx->line, size);
+	if (!line) {
+		LOG_ERROR("Out of Memory");
+		return false;
+	}
+
+	ctx->line		= line;
+	ctx->line_size	= size;
+
+	return true;
+}
+
+/* black around the 'width' x 'height' image at ('x', 'y') */
+static void
+fill_border(uint8_t *dst, uint32_t dst_width, uint32_t dst_height,
+	uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+	size_t dst_stride = (size_t)dst_width * MJPEG_BPP;
+	uint32_t row;
+
+	if (width == dst_width && height == dst_height)
+		return;
+
+	memset(dst, 0, y * dst_stride);
+
+	for (row = y; row < y + height; row++) {
+		uint8_t *p = dst + row * dst_stride;
+
+		memset(p, 0, x * MJPEG_BPP);
+		memset(p + (x + width) * MJPEG_BPP, 0, (dst_width - x - width) * MJPEG_BPP);
+	}
+
+	memset(dst + (y + height) * dst_stride, 0, (dst_height - y - height) * dst_stride);
+}
@@ -0,0 +1,252 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "probe.h"
+#include "util.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+/*
+ * Log-linear buckets : exact below 2^SUB_BITS ns, above that every power of
+ * two is split in 2^SUB_BITS, within 1/32 of the value. Longer than
+ * 2^MAX_BITS ns (18 min) goes in the last.
+ */
+#define SUB_BITS		5
+#define MAX_BITS		40
+#define BUCKETS			((MAX_BITS - SUB_BITS + 1) << SUB_BITS)
+
+
+/*======================================
+	Structure
+======================================*/
+
+/* added to from any thread, read and emptied by the reporting one */
+struct histogram {
+	atomic_uint			buckets[BUCKETS];
+	_Atomic uint64_t	max;
+};
+
+struct probe_ctx {
+	struct histogram	stages[PROBE_STAGE_NR];
+
+	/* the thread calling probe_frame() only */
+	FILE			   *fp;
+	uint64_t			period;		/* [ns] */
+	uint64_t			start;		/* of the period */
+	unsigned int		frames;
+	unsigned int		counts[BUCKETS];	/* of a stage, while reporting */
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static unsigned int get_bucket(uint64_t ns);
+static uint64_t get_bucket_end(unsigned int bucket);
+static void report(struct probe_ctx *ctx, uint64_t now);
+
+
+/*======================================
+	Variable
+======================================*/
+
+static const char *stage_names[PROBE_STAGE_NR] = {
+	[PROBE_DEQUEUE]	= "dequeue",
+	[PROBE_CONVERT]	= "convert",
+	[PROBE_COPY]	= "shm copy",
+	[PROBE_REQUEUE]	= "requeue",
+	[PROBE_HANDOFF]	= "hand-off",
+	[PROBE_COMMIT]	= "commit",
+	[PROBE_RELEASE]	= "release",
+};
+
+
+/*======================================
+	Public function
+======================================*/
+
+/* the stages and the frame rate are printed to 'fp' every 'period' [ms] */
+struct probe_ctx *
+probe_init(unsigned int period, FILE *fp)
+{
+	struct probe_ctx *ctx;
+
+	if (!period || !fp)
+		return NULL;
+
+	ctx = (struct probe_ctx *)calloc(1, sizeof(struct probe_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->fp		= fp;
+	ctx->period	= period * 1000000ULL;
+
+	return ctx;
+}
+
+void
+probe_terminate(struct probe_ctx *ctx)
+{
+	free(ctx);
+}
+
+/* a stage of one frame, CLOCK_MONOTONIC [ns]. A few ns, no lock */
+void
+probe_add(struct probe_ctx *ctx, enum probe_stage stage, uint64_t start, uint64_t end)
+{
+	struct histogram *hist;
+	uint64_t ns, max;
+
+	if (!ctx || stage >= PROBE_STAGE_NR)
+		return;
+
+	hist = &ctx->stages[stage];
+	ns = end > start ? end - start : 0;
+
+	atomic_fetch_add_explicit(&hist->buckets[get_bucket(ns)], 1, memory_order_relaxed);
+
+	max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+	while (ns > max && !atomic_compare_exchange_weak_explicit(&hist->max, &max, ns,
+			memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+/* a frame went through, the report is due once a period passed */
+void
+probe_frame(struct probe_ctx *ctx)
+{
+	uint64_t now;
+
+	if (!ctx)
+		return;
+
+	now = util_get_time();
+	if (!ctx->frames++ && !ctx->start)
+		ctx->start = now;
+
+	if (now - ctx->start >= ctx->period) {
+		report(ctx, now);
+		ctx->frames	= 0;
+		ctx->start	= now;
+	}
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+static unsigned int
+get_bucket(uint64_t ns)
+{
+	unsigned int shift;
+
+	if (ns < (1ULL << SUB_BITS))
+		return ns;
+
+	if (ns >= (1ULL << MAX_BITS))
+		return BUCKETS - 1;
+
+	/* the top SUB_BITS + 1 bits, the leading one picks the power of two */
+	shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+
+	return ((shift + 1) << SUB_BITS) + (unsigned int)(ns >> shift) - (1U << SUB_BITS);
+}
+
+/* the largest value of the bucket */
+static uint64_t
+get_bucket_end(unsigned int bucket)
+{
+	unsigned int shift;
+	uint64_t mantissa;
+
+	if (bucket < (1U << SUB_BITS))
+		return bucket;
+
+	shift		= (bucket >> SUB_BITS) - 1;
+	mantissa	= (bucket & ((1U << SUB_BITS) - 1)) + (1U << SUB_BITS);
+
+	return ((mantissa + 1) << shift) - 1;
+}
+
+/* percentiles of every stage timed this period [us], emptied for the next */
+static void
+report(struct probe_ctx *ctx, uint64_t now)
+{
+	static const unsigned int percents[] = { 50, 90, 99 };
+	uint64_t total, rank, sum, max, values[3];
+	unsigned int i, j, p;
+	int stage;
+
+	fprintf(ctx->fp, "%u frames in %.2f s, %.2f fps\n", ctx->frames, (now - ctx->start) * 1e-9,
+			ctx->frames * 1e9 / (now - ctx->start));
+	fprintf(ctx->fp, "%-10s %8s %9s %9s %9s %9s [us]\n", "stage", "count", "p50", "p90", "p99", "max");
+
+	for (stage = 0; stage < PROBE_STAGE_NR; stage++) {
+		struct histogram *hist = &ctx->stages[stage];
+		unsigned int *counts = ctx->counts;
+
+		total = 0;
+		for (i = 0; i < BUCKETS; i++) {
+			counts[i] = atomic_exchange_explicit(&hist->buckets[i], 0, memory_order_relaxed);
+			total += counts[i];
+		}
+		max = atomic_exchange_explicit(&hist->max, 0, memory_order_relaxed);
+
+		if (!total)
+			continue;
+
+		for (p = 0, i = 0, sum = 0; p < 3; p++) {
+			rank = (total * percents[p] + 99) / 100;
+			for (; i < BUCKETS; i++) {
+				if (sum + counts[i] >= rank)
+					break;
+				sum += counts[i];
+			}
+
+			j = i < BUCKETS ? i : BUCKETS - 1;
+			values[p] = get_bucket_end(j) < max ? get_bucket_end(j) : max;
+		}
+
+		fprintf(ctx->fp, "%-10s %8" PRIu64 " %9.1f %9.1f %9.1f %9.1f\n", stage_names[stage], total,
+				values[0] * 1e-3, values[1] * 1e-3, values[2] * 1e-3, max * 1e-3);
+	}
+}
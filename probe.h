@@ -0,0 +1,78 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef _PROBE_H
+#define _PROBE_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+/*======================================
+	Constant
+======================================*/
+
+/* where a frame spends its time, each one timed on its own */
+enum probe_stage {
+	PROBE_DEQUEUE = 0,	/* captured -> dequeued */
+	PROBE_CONVERT,		/* converted or decoded into the buffer */
+	PROBE_COPY,			/* copied into the buffer, the formats match */
+	PROBE_REQUEUE,		/* the camera buffer back to the source */
+	PROBE_HANDOFF,		/* converted -> presenting starts */
+	PROBE_COMMIT,		/* attach, damage and commit */
+	PROBE_RELEASE,		/* commit -> the output releases the buffer */
+	PROBE_STAGE_NR
+};
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct probe_ctx;
+
+
+/*======================================
+	Prototype
+======================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct probe_ctx *probe_init(unsigned int period, FILE *fp);
+void probe_terminate(struct probe_ctx *ctx);
+
+void probe_add(struct probe_ctx *ctx, enum probe_stage stage, uint64_t start, uint64_t end);
+void probe_frame(struct probe_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _PROBE_H */
@@ -0,0 +1,196 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "common.h"
+#include "ring.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define RING_MAX		1024
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct ring_ctx {
+	unsigned int		mask;		/* size - 1, size a power of two */
+	_Atomic(void *)	   *items;
+
+	atomic_uint			head;		/* next push, producer only */
+	atomic_uint			tail;		/* next pop, claimed with a CAS by any consumer */
+
+	int					fd;			/* eventfd, readable after a push */
+};
+
+
+/*======================================
+	Public function
+======================================*/
+
+/* 'size' is rounded up to a power of two */
+struct ring_ctx *
+ring_init(unsigned int size)
+{
+	struct ring_ctx *ctx;
+	unsigned int i, n;
+
+	if (size < 1 || size > RING_MAX) {
+		LOG_ERROR("size(%u) must be in [1, %d]", size, RING_MAX);
+		return NULL;
+	}
+
+	for (n = 1; n < size; n <<= 1)
+		;
+
+	ctx = (struct ring_ctx *)calloc(1, sizeof(struct ring_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->items = calloc(n, sizeof(*ctx->items));
+	if (!ctx->items) {
+		LOG_ERROR("Out of Memory");
+		free(ctx);
+		return NULL;
+	}
+
+	ctx->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ctx->fd < 0) {
+		LOG_PERROR("eventfd");
+		free(ctx->items);
+		free(ctx);
+		return NULL;
+	}
+
+	ctx->mask = n - 1;
+	for (i = 0; i < n; i++)
+		atomic_init(&ctx->items[i], NULL);
+	atomic_init(&ctx->head, 0);
+	atomic_init(&ctx->tail, 0);
+
+	return ctx;
+}
+
+void
+ring_terminate(struct ring_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	close(ctx->fd);
+	free(ctx->items);
+	free(ctx);
+}
+
+/* false when full */
+bool
+ring_push(struct ring_ctx *ctx, void *item)
+{
+	uint64_t one = 1;
+	unsigned int head;
+
+	if (!ctx)
+		return false;
+
+	head = atomic_load_explicit(&ctx->head, memory_order_relaxed);
+	if (head - atomic_load_explicit(&ctx->tail, memory_order_acquire) > ctx->mask)
+		return false;
+
+	atomic_store_explicit(&ctx->items[head & ctx->mask], item, memory_order_relaxed);
+	atomic_store_explicit(&ctx->head, head + 1, memory_order_release);
+
+	if (write(ctx->fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		LOG_PERROR("write");
+
+	return true;
+}
+
+/*
+ * The oldest entry, NULL when empty. The entry is read before it is claimed :
+ * when another consumer wins the slot and ring_push() refills it meanwhile,
+ * the CAS fails and the next one is tried.
+ */
+void *
+ring_pop(struct ring_ctx *ctx)
+{
+	unsigned int tail;
+	void *item;
+
+	if (!ctx)
+		return NULL;
+
+	tail = atomic_load_explicit(&ctx->tail, memory_order_acquire);
+
+	do {
+		if (tail == atomic_load_explicit(&ctx->head, memory_order_acquire))
+			return NULL;
+
+		item = atomic_load_explicit(&ctx->items[tail & ctx->mask], memory_order_relaxed);
+	} while (!atomic_compare_exchange_weak_explicit(&ctx->tail, &tail, tail + 1,
+			memory_order_acq_rel, memory_order_acquire));
+
+	return item;
+}
+
+/* poll this for pushes, ring_ack() it before popping */
+int
+ring_get_fd(struct ring_ctx *ctx)
+{
+	if (!ctx)
+		return -1;
+
+	return ctx->fd;
+}
+
+void
+ring_ack(struct ring_ctx *ctx)
+{
+	uint64_t count;
+
+	if (!ctx)
+		return;
+
+	if (read(ctx->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		LOG_PERROR("read");
+}
+
@@ -0,0 +1,69 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+#ifndef _RING_H
+#define _RING_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdbool.h>
+
+
+/*======================================
+	Structure
+======================================*/
+
+/*
+ * Lock-free single-producer/multi-consumer ring of pointers. Only one thread
+ * pushes, any thread pops : the producer may pop the oldest entry back
+ * itself, racing the consumer for it, which makes a drop-oldest queue.
+ */
+struct ring_ctx;
+
+
+/*======================================
+	Prototype
+======================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct ring_ctx *ring_init(unsigned int size);
+void ring_terminate(struct ring_ctx *ctx);
+
+/* the one producer */
+bool ring_push(struct ring_ctx *ctx, void *item);
+
+/* any thread */
+void *ring_pop(struct ring_ctx *ctx);
+int ring_get_fd(struct ring_ctx *ctx);
+void ring_ack(struct ring_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _RING_H */
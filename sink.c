@@ -0,0 +1,268 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "sink.h"
+#include "sink_backend.h"
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct sink_ctx {
+	const struct sink_backend *backend;
+	void *priv;
+};
+
+
+/*======================================
+	Variable
+======================================*/
+
+static const struct sink_backend *backends[] = {
+	&sink_wayland_backend,
+	&sink_null_backend,
+};
+
+
+/*======================================
+	Public function
+======================================*/
+
+/*
+ * 'name' is "wayland" or "null", optionally followed by ":arg" for the
+ * backend. 'formats' are tried in order, 'buffers_nr' are cycled.
+ */
+struct sink_ctx *
+sink_init(const char *name, unsigned int width, unsigned int height,
+	const uint32_t *formats, unsigned int formats_nr, unsigned int buffers_nr)
+{
+	const struct sink_backend *backend = NULL;
+	struct sink_ctx *ctx;
+	const char *arg;
+	size_t len;
+	unsigned int i;
+
+	if (!name || !formats)
+		return NULL;
+
+	arg = strchr(name, ':');
+	len = arg ? (size_t)(arg - name) : strlen(name);
+
+	for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+		if (strlen(backends[i]->name) == len && strncmp(backends[i]->name, name, len) == 0)
+			backend = backends[i];
+
+	if (!backend) {
+		LOG_ERROR("Unknown output '%s'", name);
+		return NULL;
+	}
+
+	ctx = (struct sink_ctx *)calloc(1, sizeof(struct sink_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->backend = backend;
+	ctx->priv = backend->init(arg ? arg + 1 : NULL, width, height, formats, formats_nr, buffers_nr);
+	if (!ctx->priv) {
+		free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+void
+sink_terminate(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	ctx->backend->terminate(ctx->priv);
+	free(ctx);
+}
+
+const char *
+sink_get_name(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return NULL;
+
+	return ctx->backend->name;
+}
+
+unsigned int
+sink_get_width(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return 0;
+
+	return ctx->backend->get_width(ctx->priv);
+}
+
+unsigned int
+sink_get_height(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return 0;
+
+	return ctx->backend->get_height(ctx->priv);
+}
+
+uint32_t
+sink_get_format(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return 0;
+
+	return ctx->backend->get_format(ctx->priv);
+}
+
+/* false once the user asked to quit */
+bool
+sink_is_running(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->backend->is_running(ctx->priv);
+}
+
+int
+sink_get_fd(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return -1;
+
+	return ctx->backend->get_fd(ctx->priv);
+}
+
+/*
+ * To be called before polling the fd, and followed by sink_read_events()
+ * when it polled ready or sink_cancel_read() when it did not.
+ */
+bool
+sink_prepare_read(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->backend->prepare_read(ctx->priv);
+}
+
+bool
+sink_read_events(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->backend->read_events(ctx->priv);
+}
+
+/* after sink_prepare_read() : poll the fd writable too, output is waiting for room */
+bool
+sink_needs_writable(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->backend->needs_writable(ctx->priv);
+}
+
+void
+sink_cancel_read(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	ctx->backend->cancel_read(ctx->priv);
+}
+
+/*
+ * A free buffer of the current output size, busy until it was presented
+ * and the output is done with it. NULL when all are busy.
+ */
+void *
+sink_acquire_buffer(struct sink_ctx *ctx, unsigned int *width, unsigned int *height)
+{
+	if (!ctx)
+		return NULL;
+
+	return ctx->backend->acquire_buffer(ctx->priv, width, height);
+}
+
+/*
+ * Shown on the next refresh, a buffer presented before replaces it. 'rects'
+ * is what changed since the previous one, NULL for all of it.
+ */
+bool
+sink_present_buffer(struct sink_ctx *ctx, void *data, uint32_t tag,
+	const struct sink_rect *rects, unsigned int rects_nr)
+{
+	if (!ctx || !data)
+		return false;
+
+	return ctx->backend->present_buffer(ctx->priv, data, tag, rects, rects_nr);
+}
+
+bool
+sink_set_feedback(struct sink_ctx *ctx, sink_feedback_func func, void *arg)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->backend->set_feedback(ctx->priv, func, arg);
+}
+
+bool
+sink_set_release(struct sink_ctx *ctx, sink_release_func func, void *arg)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->backend->set_release(ctx->priv, func, arg);
+}
+
+/* a presented buffer waits for the next refresh */
+bool
+sink_is_presenting(struct sink_ctx *ctx)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->backend->is_presenting(ctx->priv);
+}
@@ -0,0 +1,106 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+#ifndef _SINK_H
+#define _SINK_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wayland.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define SINK_RECT_MAX	WAYLAND_RECT_MAX	/* damage rectangles per present, more damages the whole buffer */
+
+
+/*======================================
+	Structure
+======================================*/
+
+/*
+ * Where converted frames go : a Wayland window, or nowhere for benchmarks.
+ * Buffers are acquired, filled from any thread and presented, the fd polls
+ * readable when sink_read_events() has something to do.
+ */
+struct sink_ctx;
+
+/* in buffer pixels */
+struct sink_rect {
+	int32_t x, y;
+	int32_t width, height;
+};
+
+/*
+ * Called once a presented buffer was shown, 'tag' is the one it was
+ * presented with. Times are CLOCK_MONOTONIC [ns], 'presented' is 0 when
+ * the buffer was never shown.
+ */
+typedef void (*sink_feedback_func)(void *arg, uint32_t tag, uint64_t commit, uint64_t presented);
+
+/* Called once the output is done with a presented buffer, it may be reused */
+typedef void (*sink_release_func)(void *arg, uint32_t tag, uint64_t commit, uint64_t released);
+
+
+/*======================================
+	Prototype
+======================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct sink_ctx *sink_init(const char *name, unsigned int width, unsigned int height,
+	const uint32_t *formats, unsigned int formats_nr, unsigned int buffers_nr);
+void sink_terminate(struct sink_ctx *ctx);
+const char *sink_get_name(struct sink_ctx *ctx);
+unsigned int sink_get_width(struct sink_ctx *ctx);
+unsigned int sink_get_height(struct sink_ctx *ctx);
+uint32_t sink_get_format(struct sink_ctx *ctx);
+bool sink_is_running(struct sink_ctx *ctx);
+
+int sink_get_fd(struct sink_ctx *ctx);
+bool sink_prepare_read(struct sink_ctx *ctx);
+bool sink_read_events(struct sink_ctx *ctx);
+bool sink_needs_writable(struct sink_ctx *ctx);
+void sink_cancel_read(struct sink_ctx *ctx);
+
+void *sink_acquire_buffer(struct sink_ctx *ctx, unsigned int *width, unsigned int *height);
+bool sink_present_buffer(struct sink_ctx *ctx, void *data, uint32_t tag,
+	const struct sink_rect *rects, unsigned int rects_nr);
+bool sink_set_feedback(struct sink_ctx *ctx, sink_feedback_func func, void *arg);
+bool sink_set_release(struct sink_ctx *ctx, sink_release_func func, void *arg);
+bool sink_is_presenting(struct sink_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _SINK_H */
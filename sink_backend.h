@@ -0,0 +1,77 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+#ifndef _SINK_BACKEND_H
+#define _SINK_BACKEND_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sink.h"
+
+
+/*======================================
+	Structure
+======================================*/
+
+/* what an output implements, sink.c checks the arguments */
+struct sink_backend {
+	const char *name;
+
+	/* 'arg' : what followed "name:", NULL without */
+	void   *(*init)(const char *arg, unsigned int width, unsigned int height,
+				const uint32_t *formats, unsigned int formats_nr, unsigned int buffers_nr);
+	void	(*terminate)(void *priv);
+	unsigned int	(*get_width)(void *priv);
+	unsigned int	(*get_height)(void *priv);
+	uint32_t		(*get_format)(void *priv);
+	bool	(*is_running)(void *priv);
+
+	int		(*get_fd)(void *priv);
+	bool	(*prepare_read)(void *priv);
+	bool	(*read_events)(void *priv);
+	bool	(*needs_writable)(void *priv);
+	void	(*cancel_read)(void *priv);
+
+	void   *(*acquire_buffer)(void *priv, unsigned int *width, unsigned int *height);
+	/* NULL 'rects' : the whole buffer changed */
+	bool	(*present_buffer)(void *priv, void *data, uint32_t tag,
+				const struct sink_rect *rects, unsigned int rects_nr);
+	bool	(*set_feedback)(void *priv, sink_feedback_func func, void *arg);
+	bool	(*set_release)(void *priv, sink_release_func func, void *arg);
+	bool	(*is_presenting)(void *priv);
+};
+
+
+/*======================================
+	Variable
+======================================*/
+
+extern const struct sink_backend sink_wayland_backend;
+extern const struct sink_backend sink_null_backend;
+
+#endif /* _SINK_BACKEND_H */
@@ -0,0 +1,461 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "common.h"
+#include "sink.h"
+#include "sink_backend.h"
+#include "format.h"
+#include "util.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define BUFFER_MAX		8
+#define BUFFER_ALIGN	4096
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct null_buffer {
+	void   *data;
+	bool	busy;
+};
+
+/*
+ * Takes frames as fast as they come, or one per tick of a fake vsync, and
+ * counts them. Buffers are plain memory, laid out like the wl_shm ones.
+ */
+struct null_sink {
+	unsigned int		width, height;
+	uint32_t			format;
+
+	struct null_buffer	buffers[BUFFER_MAX];
+	unsigned int		buffers_nr;
+
+	unsigned int		fps;		/* 0 : no vsync */
+	int					fd;			/* timerfd, an eventfd that never fires without vsync */
+
+	struct null_buffer *pending;	/* waiting for the next tick */
+	uint32_t			pending_tag;
+	uint64_t			pending_commit;
+	struct null_buffer *shown;		/* held until the next one is shown */
+	uint32_t			shown_tag;
+	uint64_t			shown_commit;
+
+	sink_feedback_func	feedback_func;
+	void			   *feedback_arg;
+	sink_release_func	release_func;
+	void			   *release_arg;
+
+	uint64_t			frames, replaced;
+	uint64_t			first, last;	/* shown [ns] */
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static void *null_init(const char *arg, unsigned int width, unsigned int height,
+	const uint32_t *formats, unsigned int formats_nr, unsigned int buffers_nr);
+static void null_terminate(void *priv);
+static unsigned int null_get_width(void *priv);
+static unsigned int null_get_height(void *priv);
+static uint32_t null_get_format(void *priv);
+static bool null_is_running(void *priv);
+static int null_get_fd(void *priv);
+static bool null_prepare_read(void *priv);
+static bool null_read_events(void *priv);
+static bool null_needs_writable(void *priv);
+static void null_cancel_read(void *priv);
+static void *null_acquire_buffer(void *priv, unsigned int *width, unsigned int *height);
+static bool null_present_buffer(void *priv, void *data, uint32_t tag,
+	const struct sink_rect *rects, unsigned int rects_nr);
+static bool null_set_feedback(void *priv, sink_feedback_func func, void *arg);
+static bool null_set_release(void *priv, sink_release_func func, void *arg);
+static bool null_is_presenting(void *priv);
+
+static void show(struct null_sink *sink, struct null_buffer *buffer, uint32_t tag, uint64_t commit);
+static void release_shown(struct null_sink *sink, uint64_t now);
+static void signal_int(int signum);
+
+
+/*======================================
+	Variable
+======================================*/
+
+const struct sink_backend sink_null_backend = {
+	.name			= "null",
+	.init			= null_init,
+	.terminate		= null_terminate,
+	.get_width		= null_get_width,
+	.get_height		= null_get_height,
+	.get_format		= null_get_format,
+	.is_running		= null_is_running,
+	.get_fd			= null_get_fd,
+	.prepare_read	= null_prepare_read,
+	.read_events	= null_read_events,
+	.needs_writable	= null_needs_writable,
+	.cancel_read	= null_cancel_read,
+	.acquire_buffer	= null_acquire_buffer,
+	.present_buffer	= null_present_buffer,
+	.set_feedback	= null_set_feedback,
+	.set_release	= null_set_release,
+	.is_presenting	= null_is_presenting,
+};
+
+static volatile sig_atomic_t running = 1;
+
+
+/*======================================
+	Inner function
+======================================*/
+
+/*
+ * 'arg' is the fake refresh rate, none by default. Only RGB is taken, so
+ * frames go through the same conversion as for a compositor.
+ */
+static void *
+null_init(const char *arg, unsigned int width, unsigned int height,
+	const uint32_t *formats, unsigned int formats_nr, unsigned int buffers_nr)
+{
+	struct sigaction sigint;
+	struct null_sink *sink;
+	size_t size;
+	unsigned int i;
+
+	if (buffers_nr < 2 || buffers_nr > BUFFER_MAX) {
+		LOG_ERROR("buffers_nr(%u) must be in [2, %d]", buffers_nr, BUFFER_MAX);
+		return NULL;
+	}
+
+	sink = (struct null_sink *)calloc(1, sizeof(struct null_sink));
+	if (!sink) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	sink->width = width;
+	sink->height = height;
+	sink->buffers_nr = buffers_nr;
+	sink->fps = arg ? strtoul(arg, NULL, 0) : 0;
+	sink->fd = -1;
+
+	for (i = 0; i < formats_nr; i++)
+		if (formats[i] == FORMAT_XRGB8888 || formats[i] == FORMAT_ARGB8888)
+			break;
+
+	if (i == formats_nr) {
+		LOG_ERROR("None of the %u requested formats is RGB", formats_nr);
+		goto err;
+	}
+
+	sink->format = formats[i];
+
+	size = format_get_frame_size(sink->format, width, height);
+	size = (size + BUFFER_ALIGN - 1) & ~(size_t)(BUFFER_ALIGN - 1);
+
+	for (i = 0; i < buffers_nr; i++) {
+		sink->buffers[i].data = aligned_alloc(BUFFER_ALIGN, size);
+		if (!sink->buffers[i].data) {
+			LOG_ERROR("Out of Memory");
+			goto err;
+		}
+
+		format_fill_white(sink->format, sink->buffers[i].data, width, height);
+	}
+
+	if (sink->fps) {
+		struct itimerspec its = { 0 };
+		uint64_t period = 1000000000ULL / sink->fps;
+
+		its.it_interval.tv_sec	= period / 1000000000ULL;
+		its.it_interval.tv_nsec	= period % 1000000000ULL;
+		its.it_value = its.it_interval;
+
+		sink->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		if (sink->fd < 0 || timerfd_settime(sink->fd, 0, &its, NULL) < 0) {
+			LOG_PERROR("timerfd");
+			goto err;
+		}
+	} else {
+		sink->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (sink->fd < 0) {
+			LOG_PERROR("eventfd");
+			goto err;
+		}
+	}
+
+	sigint.sa_handler = signal_int;
+	sigemptyset(&sigint.sa_mask);
+	sigint.sa_flags = SA_RESETHAND;
+	sigaction(SIGINT, &sigint, NULL);
+
+	return sink;
+
+err:
+	null_terminate(sink);
+	return NULL;
+}
+
+/* the throughput is what this sink is for, it is always reported */
+static void
+null_terminate(void *priv)
+{
+	struct null_sink *sink = priv;
+	unsigned int i;
+
+	if (sink->frames > 1 && sink->last > sink->first)
+		printf("null sink : %" PRIu64 " frames in %.3f s, %.2f fps, %" PRIu64 " replaced before a tick\n",
+				sink->frames, (sink->last - sink->first) / 1e9,
+				(sink->frames - 1) * 1e9 / (sink->last - sink->first), sink->replaced);
+
+	if (sink->fd >= 0)
+		close(sink->fd);
+
+	for (i = 0; i < sink->buffers_nr; i++)
+		free(sink->buffers[i].data);
+	free(sink);
+}
+
+static unsigned int
+null_get_width(void *priv)
+{
+	struct null_sink *sink = priv;
+
+	return sink->width;
+}
+
+static unsigned int
+null_get_height(void *priv)
+{
+	struct null_sink *sink = priv;
+
+	return sink->height;
+}
+
+static uint32_t
+null_get_format(void *priv)
+{
+	struct null_sink *sink = priv;
+
+	return sink->format;
+}
+
+static bool
+null_is_running(void *priv)
+{
+	return running;
+}
+
+static int
+null_get_fd(void *priv)
+{
+	struct null_sink *sink = priv;
+
+	return sink->fd;
+}
+
+static bool
+null_prepare_read(void *priv)
+{
+	return true;
+}
+
+/* a vsync tick, the pending buffer is shown */
+static bool
+null_read_events(void *priv)
+{
+	struct null_sink *sink = priv;
+	uint64_t ticks;
+
+	if (read(sink->fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+		return true;
+
+	if (sink->pending) {
+		show(sink, sink->pending, sink->pending_tag, sink->pending_commit);
+		sink->pending = NULL;
+	}
+
+	return true;
+}
+
+/* nothing is ever written to the timer */
+static bool
+null_needs_writable(void *priv)
+{
+	return false;
+}
+
+static void
+null_cancel_read(void *priv)
+{
+}
+
+static void *
+null_acquire_buffer(void *priv, unsigned int *width, unsigned int *height)
+{
+	struct null_sink *sink = priv;
+	unsigned int i;
+
+	for (i = 0; i < sink->buffers_nr; i++) {
+		if (sink->buffers[i].busy)
+			continue;
+
+		sink->buffers[i].busy = true;
+
+		if (width)
+			*width = sink->width;
+		if (height)
+			*height = sink->height;
+
+		return sink->buffers[i].data;
+	}
+
+	return NULL;
+}
+
+/* without vsync, shown and done with right away */
+static bool
+null_present_buffer(void *priv, void *data, uint32_t tag,
+	const struct sink_rect *rects, unsigned int rects_nr)
+{
+	struct null_sink *sink = priv;
+	struct null_buffer *buffer = NULL;
+	unsigned int i;
+
+	for (i = 0; i < sink->buffers_nr; i++)
+		if (sink->buffers[i].data == data && sink->buffers[i].busy)
+			buffer = &sink->buffers[i];
+
+	if (!buffer) {
+		LOG_ERROR("%p is no acquired buffer", data);
+		return false;
+	}
+
+	if (!sink->fps) {
+		show(sink, buffer, tag, util_get_time());
+		release_shown(sink, util_get_time());
+		return true;
+	}
+
+	if (sink->pending) {
+		sink->pending->busy = false;
+		sink->replaced++;
+	}
+
+	sink->pending = buffer;
+	sink->pending_tag = tag;
+	sink->pending_commit = util_get_time();
+
+	return true;
+}
+
+static bool
+null_set_feedback(void *priv, sink_feedback_func func, void *arg)
+{
+	struct null_sink *sink = priv;
+
+	sink->feedback_func = func;
+	sink->feedback_arg = arg;
+
+	return true;
+}
+
+static bool
+null_set_release(void *priv, sink_release_func func, void *arg)
+{
+	struct null_sink *sink = priv;
+
+	sink->release_func = func;
+	sink->release_arg = arg;
+
+	return true;
+}
+
+static bool
+null_is_presenting(void *priv)
+{
+	struct null_sink *sink = priv;
+
+	return sink->pending != NULL;
+}
+
+/* the previously shown buffer is free again */
+static void
+show(struct null_sink *sink, struct null_buffer *buffer, uint32_t tag, uint64_t commit)
+{
+	uint64_t now = util_get_time();
+
+	release_shown(sink, now);
+	sink->shown = buffer;
+	sink->shown_tag = tag;
+	sink->shown_commit = commit;
+
+	if (!sink->frames++)
+		sink->first = now;
+	sink->last = now;
+
+	if (sink->feedback_func)
+		sink->feedback_func(sink->feedback_arg, tag, commit, now);
+}
+
+/* the shown buffer is free again */
+static void
+release_shown(struct null_sink *sink, uint64_t now)
+{
+	if (!sink->shown)
+		return;
+
+	sink->shown->busy = false;
+	if (sink->release_func)
+		sink->release_func(sink->release_arg, sink->shown_tag, sink->shown_commit, now);
+	sink->shown = NULL;
+}
+
+static void
+signal_int(int signum)
+{
+	running = 0;
+}
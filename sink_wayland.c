@@ -0,0 +1,202 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "sink.h"
+#include "sink_backend.h"
+#include "wayland.h"
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static void *wayland_sink_init(const char *arg, unsigned int width, unsigned int height,
+	const uint32_t *formats, unsigned int formats_nr, unsigned int buffers_nr);
+static void wayland_sink_terminate(void *priv);
+static unsigned int wayland_sink_get_width(void *priv);
+static unsigned int wayland_sink_get_height(void *priv);
+static uint32_t wayland_sink_get_format(void *priv);
+static bool wayland_sink_is_running(void *priv);
+static int wayland_sink_get_fd(void *priv);
+static bool wayland_sink_prepare_read(void *priv);
+static bool wayland_sink_read_events(void *priv);
+static bool wayland_sink_needs_writable(void *priv);
+static void wayland_sink_cancel_read(void *priv);
+static void *wayland_sink_acquire_buffer(void *priv, unsigned int *width, unsigned int *height);
+static bool wayland_sink_present_buffer(void *priv, void *data, uint32_t tag,
+	const struct sink_rect *rects, unsigned int rects_nr);
+static bool wayland_sink_set_feedback(void *priv, sink_feedback_func func, void *arg);
+static bool wayland_sink_set_release(void *priv, sink_release_func func, void *arg);
+static bool wayland_sink_is_presenting(void *priv);
+
+
+/*======================================
+	Variable
+======================================*/
+
+const struct sink_backend sink_wayland_backend = {
+	.name			= "wayland",
+	.init			= wayland_sink_init,
+	.terminate		= wayland_sink_terminate,
+	.get_width		= wayland_sink_get_width,
+	.get_height		= wayland_sink_get_height,
+	.get_format		= wayland_sink_get_format,
+	.is_running		= wayland_sink_is_running,
+	.get_fd			= wayland_sink_get_fd,
+	.prepare_read	= wayland_sink_prepare_read,
+	.read_events	= wayland_sink_read_events,
+	.needs_writable	= wayland_sink_needs_writable,
+	.cancel_read	= wayland_sink_cancel_read,
+	.acquire_buffer	= wayland_sink_acquire_buffer,
+	.present_buffer	= wayland_sink_present_buffer,
+	.set_feedback	= wayland_sink_set_feedback,
+	.set_release	= wayland_sink_set_release,
+	.is_presenting	= wayland_sink_is_presenting,
+};
+
+
+/*======================================
+	Inner function
+======================================*/
+
+static void *
+wayland_sink_init(const char *arg, unsigned int width, unsigned int height,
+	const uint32_t *formats, unsigned int formats_nr, unsigned int buffers_nr)
+{
+	return wayland_init(width, height, formats, formats_nr, buffers_nr);
+}
+
+static void
+wayland_sink_terminate(void *priv)
+{
+	wayland_terminate(priv);
+}
+
+static unsigned int
+wayland_sink_get_width(void *priv)
+{
+	return wayland_get_width(priv);
+}
+
+static unsigned int
+wayland_sink_get_height(void *priv)
+{
+	return wayland_get_height(priv);
+}
+
+static uint32_t
+wayland_sink_get_format(void *priv)
+{
+	return wayland_get_format(priv);
+}
+
+static bool
+wayland_sink_is_running(void *priv)
+{
+	return wayland_is_running();
+}
+
+static int
+wayland_sink_get_fd(void *priv)
+{
+	return wayland_get_fd(priv);
+}
+
+static bool
+wayland_sink_prepare_read(void *priv)
+{
+	return wayland_prepare_read(priv);
+}
+
+static bool
+wayland_sink_read_events(void *priv)
+{
+	return wayland_read_events(priv);
+}
+
+static bool
+wayland_sink_needs_writable(void *priv)
+{
+	return wayland_needs_writable(priv);
+}
+
+static void
+wayland_sink_cancel_read(void *priv)
+{
+	wayland_cancel_read(priv);
+}
+
+static void *
+wayland_sink_acquire_buffer(void *priv, unsigned int *width, unsigned int *height)
+{
+	return wayland_acquire_buffer(priv, width, height);
+}
+
+static bool
+wayland_sink_present_buffer(void *priv, void *data, uint32_t tag,
+	const struct sink_rect *rects, unsigned int rects_nr)
+{
+	struct wayland_rect damage[WAYLAND_RECT_MAX];
+	unsigned int i;
+
+	if (!rects || rects_nr > WAYLAND_RECT_MAX)
+		return wayland_present_buffer(priv, data, tag);
+
+	for (i = 0; i < rects_nr; i++) {
+		damage[i].x			= rects[i].x;
+		damage[i].y			= rects[i].y;
+		damage[i].width		= rects[i].width;
+		damage[i].height	= rects[i].height;
+	}
+
+	return wayland_present_damage(priv, data, tag, damage, rects_nr);
+}
+
+static bool
+wayland_sink_set_feedback(void *priv, sink_feedback_func func, void *arg)
+{
+	return wayland_set_feedback(priv, func, arg);
+}
+
+static bool
+wayland_sink_set_release(void *priv, sink_release_func func, void *arg)
+{
+	return wayland_set_release(priv, func, arg);
+}
+
+static bool
+wayland_sink_is_presenting(void *priv)
+{
+	return wayland_is_presenting(priv);
+}
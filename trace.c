@@ -0,0 +1,318 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "trace.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define THREADS_MAX		8		/* named ones, more stay unnamed */
+#define THREAD_NAME_MAX	16
+
+
+/*======================================
+	Structure
+======================================*/
+
+/*
+ * 'stamp' is 0 while the record is written, and its index + 1 once done.
+ * A flush skips the ones it finds half written or overwritten.
+ */
+struct trace_record {
+	_Atomic uint64_t	stamp;
+	uint64_t			begin, end;		/* CLOCK_MONOTONIC [ns] */
+	uint32_t			sequence;
+	uint32_t			tid;
+	uint32_t			event;
+};
+
+struct trace_thread {
+	uint32_t	tid;
+	char		name[THREAD_NAME_MAX];
+};
+
+/*
+ * A flight recorder : the newest 'records_nr' events, preallocated. Any
+ * thread adds with one atomic increment, no lock and no allocation.
+ */
+struct trace_ctx {
+	char				   *path;
+	struct trace_record	   *records;
+	uint64_t				mask;		/* records_nr - 1 */
+	_Atomic uint64_t		head;		/* events ever added */
+
+	struct trace_thread		threads[THREADS_MAX];
+	atomic_uint				threads_nr;
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static uint32_t get_tid(void);
+
+
+/*======================================
+	Variable
+======================================*/
+
+static const char *event_names[TRACE_EVENT_NR] = {
+	[TRACE_DEQUEUE]	= "dequeue",
+	[TRACE_CONVERT]	= "convert",
+	[TRACE_COPY]	= "shm copy",
+	[TRACE_REQUEUE]	= "requeue",
+	[TRACE_HANDOFF]	= "hand-off",
+	[TRACE_COMMIT]	= "commit",
+	[TRACE_PRESENT]	= "present",
+	[TRACE_RELEASE]	= "release",
+};
+
+/* waiting rather than running, async slices : they overlap from frame to frame */
+static const bool event_waits[TRACE_EVENT_NR] = {
+	[TRACE_DEQUEUE]	= true,
+	[TRACE_HANDOFF]	= true,
+	[TRACE_PRESENT]	= true,
+	[TRACE_RELEASE]	= true,
+};
+
+static __thread uint32_t thread_tid;
+
+
+/*======================================
+	Public function
+======================================*/
+
+/* 'events_nr' is rounded up to a power of two, 'path' is written by trace_flush() */
+struct trace_ctx *
+trace_init(const char *path, unsigned int events_nr)
+{
+	struct trace_ctx *ctx;
+	uint64_t records_nr = 1;
+	FILE *fp;
+
+	if (!path || !events_nr)
+		return NULL;
+
+	/* fail now rather than after the run */
+	fp = fopen(path, "w");
+	if (!fp) {
+		LOG_ERROR("Cannot open '%s' : %d, %s", path, errno, strerror(errno));
+		return NULL;
+	}
+	fclose(fp);
+
+	while (records_nr < events_nr)
+		records_nr <<= 1;
+
+	ctx = (struct trace_ctx *)calloc(1, sizeof(struct trace_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->path = strdup(path);
+	ctx->records = calloc(records_nr, sizeof(struct trace_record));
+	if (!ctx->path || !ctx->records) {
+		LOG_ERROR("Out of Memory");
+		trace_terminate(ctx);
+		return NULL;
+	}
+
+	ctx->mask = records_nr - 1;
+
+	return ctx;
+}
+
+void
+trace_terminate(struct trace_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	free(ctx->records);
+	free(ctx->path);
+	free(ctx);
+}
+
+/* the calling thread's name in the viewer, once per thread */
+void
+trace_name_thread(struct trace_ctx *ctx, const char *name)
+{
+	unsigned int i;
+
+	if (!ctx || !name)
+		return;
+
+	i = atomic_fetch_add(&ctx->threads_nr, 1);
+	if (i >= THREADS_MAX)
+		return;
+
+	ctx->threads[i].tid = get_tid();
+	snprintf(ctx->threads[i].name, sizeof(ctx->threads[i].name), "%s", name);
+}
+
+/* a stage of frame 'sequence' on the calling thread, CLOCK_MONOTONIC [ns] */
+void
+trace_add(struct trace_ctx *ctx, enum trace_event event, uint32_t sequence, uint64_t begin, uint64_t end)
+{
+	struct trace_record *record;
+	uint64_t index;
+
+	if (!ctx || event >= TRACE_EVENT_NR)
+		return;
+
+	index = atomic_fetch_add_explicit(&ctx->head, 1, memory_order_relaxed);
+	record = &ctx->records[index & ctx->mask];
+
+	atomic_store_explicit(&record->stamp, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	record->begin		= begin;
+	record->end			= end > begin ? end : begin;
+	record->sequence	= sequence;
+	record->tid			= get_tid();
+	record->event		= event;
+
+	atomic_store_explicit(&record->stamp, index + 1, memory_order_release);
+}
+
+/*
+ * The recorded events as a Chrome JSON trace, for chrome://tracing or the
+ * Perfetto UI. May run while events are added, the ones being written are
+ * left out. Not async-signal-safe, call it from the event loop.
+ */
+bool
+trace_flush(struct trace_ctx *ctx)
+{
+	struct trace_record record;
+	uint64_t head, index, stamp;
+	unsigned int i, threads_nr;
+	bool first = true;
+	int pid = getpid();
+	FILE *fp;
+
+	if (!ctx)
+		return false;
+
+	fp = fopen(ctx->path, "w");
+	if (!fp) {
+		LOG_ERROR("Cannot open '%s' : %d, %s", ctx->path, errno, strerror(errno));
+		return false;
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	threads_nr = atomic_load(&ctx->threads_nr);
+	for (i = 0; i < threads_nr && i < THREADS_MAX; i++) {
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%" PRIu32
+				",\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", pid, ctx->threads[i].tid,
+				ctx->threads[i].name);
+		first = false;
+	}
+
+	head = atomic_load_explicit(&ctx->head, memory_order_acquire);
+	index = head > ctx->mask + 1 ? head - (ctx->mask + 1) : 0;
+
+	for (; index < head; index++) {
+		struct trace_record *slot = &ctx->records[index & ctx->mask];
+
+		stamp = atomic_load_explicit(&slot->stamp, memory_order_acquire);
+		if (stamp != index + 1)
+			continue;
+
+		record.begin	= slot->begin;
+		record.end		= slot->end;
+		record.sequence	= slot->sequence;
+		record.tid		= slot->tid;
+		record.event	= slot->event;
+
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&slot->stamp, memory_order_relaxed) != stamp)
+			continue;
+
+		/* [us], async begin and end keyed by the sequence, or one complete event */
+		if (event_waits[record.event]) {
+			fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"b\",\"id\":%" PRIu32
+					",\"ts\":%" PRIu64 ".%03u,\"pid\":%d,\"tid\":%" PRIu32 ",\"args\":{\"sequence\":%" PRIu32 "}}",
+					first ? "" : ",\n", event_names[record.event], record.sequence,
+					record.begin / 1000, (unsigned int)(record.begin % 1000), pid, record.tid, record.sequence);
+			fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"e\",\"id\":%" PRIu32
+					",\"ts\":%" PRIu64 ".%03u,\"pid\":%d,\"tid\":%" PRIu32 "}",
+					event_names[record.event], record.sequence,
+					record.end / 1000, (unsigned int)(record.end % 1000), pid, record.tid);
+		} else {
+			fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%" PRIu64 ".%03u,"
+					"\"dur\":%" PRIu64 ".%03u,\"pid\":%d,\"tid\":%" PRIu32 ",\"args\":{\"sequence\":%" PRIu32 "}}",
+					first ? "" : ",\n", event_names[record.event],
+					record.begin / 1000, (unsigned int)(record.begin % 1000),
+					(record.end - record.begin) / 1000, (unsigned int)((record.end - record.begin) % 1000),
+					pid, record.tid, record.sequence);
+		}
+		first = false;
+	}
+
+	fprintf(fp, "\n]}\n");
+
+	if (fclose(fp) != 0) {
+		LOG_PERROR("fclose");
+		return false;
+	}
+
+	return true;
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+/* cached, a syscall per event would cost more than the rest */
+static uint32_t
+get_tid(void)
+{
+	if (!thread_tid)
+		thread_tid = syscall(SYS_gettid);
+
+	return thread_tid;
+}
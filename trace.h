@@ -0,0 +1,81 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/*======================================
+	Header include
+======================================*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*======================================
+	Constant
+======================================*/
+
+/* a stage of one frame, work on the thread that ran it, waits on tracks of their own */
+enum trace_event {
+	TRACE_DEQUEUE = 0,	/* captured -> dequeued */
+	TRACE_CONVERT,		/* converted or decoded into the buffer */
+	TRACE_COPY,			/* copied into the buffer, the formats match */
+	TRACE_REQUEUE,		/* the camera buffer back to the source */
+	TRACE_HANDOFF,		/* converted -> presenting starts */
+	TRACE_COMMIT,		/* attach, damage and commit */
+	TRACE_PRESENT,		/* commit -> on screen */
+	TRACE_RELEASE,		/* commit -> the output releases the buffer */
+	TRACE_EVENT_NR
+};
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct trace_ctx;
+
+
+/*======================================
+	Prototype
+======================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct trace_ctx *trace_init(const char *path, unsigned int events_nr);
+void trace_terminate(struct trace_ctx *ctx);
+
+void trace_name_thread(struct trace_ctx *ctx, const char *name);
+void trace_add(struct trace_ctx *ctx, enum trace_event event, uint32_t sequence, uint64_t begin, uint64_t end);
+
+bool trace_flush(struct trace_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _TRACE_H */
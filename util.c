@@ -27,49 +27,24 @@
 ======================================*/
 
 #include <stdio.h>
-#include <sys/time.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "common.h"
 #include "util.h"
 
 
-/*======================================
-	Constant
-======================================*/
-
-#define FPS_INTERVAL	5000	/* calc fps per 5000 [ms] */
-
-/*======================================
-	Variable
-======================================*/
-
-static int frame_count = -1;
-static struct timeval old_time, new_time;
-
-
 /*======================================
 	Public function
 ======================================*/
 
-void
-util_show_fps(void)
+/* CLOCK_MONOTONIC [ns], the clock of the V4L2 timestamps */
+uint64_t
+util_get_time(void)
 {
-	unsigned int ms;
+	struct timespec now;
 
-	if (frame_count < 0) {
-		gettimeofday(&old_time, NULL);
-		frame_count = 0;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	frame_count++;
-
-	gettimeofday(&new_time, NULL);
-	ms = (new_time.tv_sec * 1e3 + new_time.tv_usec * 1e-3)
-	   - (old_time.tv_sec * 1e3 + old_time.tv_usec * 1e-3);
-	if (ms >= FPS_INTERVAL) {
-		printf("%d frames in %d sec. fps = %f\n", frame_count, (int)(FPS_INTERVAL * 1e-3), frame_count / (FPS_INTERVAL * 1e-3));
-		frame_count = 0;
-		old_time = new_time;
-	}
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
 }
-
@@ -28,6 +28,9 @@
 	Header include
 ======================================*/
 
+#include <stdint.h>
+
+
 /*======================================
 	Prototype
 ======================================*/
@@ -36,7 +39,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
-void util_show_fps(void);
+uint64_t util_get_time(void);
 
 #ifdef __cplusplus
 }
@@ -29,14 +29,16 @@
 	Header include
 ======================================*/
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <signal.h>
+#include <time.h>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -44,8 +46,22 @@
 
 #include <wayland-client.h>
 
+#include "viewporter-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+
 #include "common.h"
 #include "wayland.h"
+#include "format.h"
+#include "util.h"
+
+
+/*======================================
+	Constants
+======================================*/
+
+#define BUFFER_MAX		8
+#define BUFFER_ALIGN	4096	/* every buffer starts on a page */
+#define HUGE_PAGE_SIZE	(2 * 1024 * 1024)
 
 
 /*======================================
@@ -58,25 +74,62 @@ struct display {
 	struct wl_display *display;
 	struct wl_registry *registry;
 	struct wl_compositor *compositor;
+	uint32_t compositor_version;		/* 4 : wl_surface.damage_buffer */
 	struct wl_shell *shell;
 	struct wl_shm *shm;
-	uint32_t formats;
+	struct wp_viewporter *viewporter;	/* optional */
+	struct wp_presentation *presentation;	/* optional */
+	uint32_t presentation_clock;
+	struct wl_array formats;	/* uint32_t fourcc codes */
 
 	struct wayland_ctx *ctx;
 };
 
+/* one mapping the buffers of a size are carved out of */
+struct pool {
+	struct wl_shm_pool *pool;
+	void *data;
+	size_t size;
+	size_t buffer_size;			/* page aligned */
+	int width, height;
+	unsigned int refs;			/* the window while current, and each buffer in it */
+};
+
 struct buffer {
+	struct window *window;
+	struct pool *pool;
 	struct wl_buffer *buffer;
 	void *shm_data;
+	int width, height;
 	int busy;
+	uint32_t tag;				/* from wayland_present_buffer() */
+	uint64_t commit;			/* [ns], 0 : not committed since released */
+	struct wayland_rect damage[WAYLAND_RECT_MAX];
+	int damage_nr;				/* -1 : the whole buffer */
+	struct buffer *next_free;
+};
+
+/* one per commit, until the compositor says how it went */
+struct feedback {
+	struct wayland_ctx *ctx;
+	struct wp_presentation_feedback *feedback;
+	uint32_t tag;
+	uint64_t commit;
+	struct feedback *next;
 };
 
 struct window {
 	struct display *display;
 	int width, height;
+	uint32_t format;
 	struct wl_surface *surface;
 	struct wl_shell_surface *shell_surface;
-	struct buffer buffers[2];
+	struct wp_viewport *viewport;		/* the compositor scales to dst_* */
+	int dst_width, dst_height;			/* 0 : buffer size */
+	struct buffer buffers[BUFFER_MAX];
+	unsigned int buffers_nr;
+	struct buffer *free_list;	/* pushed by buffer_release() */
+	struct pool *pool;			/* for buffers of the current size */
 	struct buffer *prev_buffer;
 	struct wl_callback *callback;
 };
@@ -84,8 +137,16 @@ struct window {
 struct wayland_ctx {
 	struct display *display;
 	struct window *window;
-	unsigned char *buffer;
-	bool buffer_empty;
+	struct buffer *pending;		/* presented, waiting for the frame callback */
+	bool reading;				/* between wayland_prepare_read() and read or cancel */
+	bool flush_blocked;			/* the socket had no room for every request */
+
+	wayland_feedback_func feedback_func;
+	void *feedback_arg;
+	struct feedback *feedbacks;	/* waiting for presented or discarded */
+
+	wayland_release_func release_func;
+	void *release_arg;
 };
 
 
@@ -98,16 +159,23 @@ static void signal_int(int signum);
 static struct display *create_display(void);
 static void destroy_display(struct display *display);
 
-static struct window *create_window(struct display *display, int width, int height);
+static struct window *create_window(struct display *display, int width, int height, uint32_t format, unsigned int buffers_nr);
 static void destroy_window(struct window *window);
 
-static int create_shm_buffer(struct display *display, struct buffer *buffer, int width, int height, uint32_t format);
-static int create_anonymous_file(off_t size);
+static struct pool *create_shm_pool(struct window *window);
+static void unref_shm_pool(struct pool *pool);
+static int create_shm_buffer(struct window *window, struct buffer *buffer);
+static void destroy_shm_buffer(struct buffer *buffer);
+static void *map_anonymous_file(off_t size, unsigned int flags, int *fd);
+static int create_anonymous_file(off_t size, unsigned int flags);
 static int set_cloexec_or_close(int fd);
 static void buffer_release(void *data, struct wl_buffer *buffer);
 
 static void redraw(void *data, struct wl_callback *callback, uint32_t time);
+static void damage_surface(struct window *window, struct buffer *buffer);
 static struct buffer *window_next_buffer(struct window *window);
+static struct buffer *window_find_buffer(struct window *window, void *shm_data);
+static void window_put_buffer(struct window *window, struct buffer *buffer);
 
 static void registry_handle_global(void *data, struct wl_registry *registry, uint32_t id, const char *interface, uint32_t version);
 static void registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name);
@@ -116,7 +184,18 @@ static void handle_ping(void *data, struct wl_shell_surface *shell_surface, uint
 static void handle_configure(void *data, struct wl_shell_surface *shell_surface, uint32_t edges, int32_t width, int32_t height);
 static void handle_popup_done(void *data, struct wl_shell_surface *shell_surface);
 
+static void presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clk_id);
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *feedback, struct wl_output *output);
+static void feedback_presented(void *data, struct wp_presentation_feedback *feedback,
+	uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh,
+	uint32_t seq_hi, uint32_t seq_lo, uint32_t flags);
+static void feedback_discarded(void *data, struct wp_presentation_feedback *feedback);
+static void feedback_done(struct feedback *feedback, uint64_t presented);
+
 static void shm_format(void *data, struct wl_shm *wl_shm, uint32_t format);
+static bool display_has_format(struct display *display, uint32_t format);
+static uint32_t shm_to_fourcc(uint32_t format);
+static uint32_t fourcc_to_shm(uint32_t format);
 
 
 /*======================================
@@ -146,6 +225,16 @@ struct wl_shm_listener shm_listener = {
 	shm_format
 };
 
+static const struct wp_presentation_listener presentation_listener = {
+	presentation_clock_id
+};
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+	feedback_sync_output,
+	feedback_presented,
+	feedback_discarded
+};
+
 static int running = 1;
 
 
@@ -153,32 +242,61 @@ static int running = 1;
 	Public functions
 ======================================*/
 
+/*
+ * 'buffers_nr' wl_shm buffers, up to BUFFER_MAX, are cycled out of one pool.
+ * More than two ride out compositors holding a buffer for longer than a
+ * frame, and let a converting thread work ahead.
+ */
 struct wayland_ctx *
-wayland_init(unsigned int width, unsigned int height)
+wayland_init(unsigned int width, unsigned int height, const uint32_t *formats, unsigned int formats_nr,
+	unsigned int buffers_nr)
 {
 	struct sigaction sigint;
 	struct display *display;
 	struct window *window;
 	struct wayland_ctx *ctx;
+	void *shm_data;
+	unsigned int i;
 
-	ctx = (struct wayland_ctx *)malloc(sizeof(struct wayland_ctx));
+	if (buffers_nr < 2 || buffers_nr > BUFFER_MAX) {
+		fprintf(stderr, "buffers_nr(%u) must be in [2, %d]\n", buffers_nr, BUFFER_MAX);
+		return NULL;
+	}
+
+	ctx = (struct wayland_ctx *)calloc(1, sizeof(struct wayland_ctx));
 	if (!ctx)
 		return NULL;
 
-	ctx->buffer = (unsigned char *)malloc(width * height * 4);
-	if (!ctx->buffer) {
+	display = create_display();
+	if (!display) {
+		free(ctx);
+		return NULL;
+	}
+
+	display->ctx = ctx;
+
+	/* first format of the caller's list the compositor can take */
+	for (i = 0; i < formats_nr; i++)
+		if (display_has_format(display, formats[i]))
+			break;
+
+	if (i == formats_nr) {
+		fprintf(stderr, "None of the %u requested wl_shm formats is available\n", formats_nr);
+		destroy_display(display);
 		free(ctx);
 		return NULL;
 	}
 
-	display = create_display();
-	window = create_window(display, width, height);
+	window = create_window(display, width, height, formats[i], buffers_nr);
 	if (!window) {
-		free(ctx->buffer);
+		destroy_display(display);
 		free(ctx);
 		return NULL;
 	}
 
+	ctx->display = display;
+	ctx->window = window;
+
 	sigint.sa_handler = signal_int;
 	sigemptyset(&sigint.sa_mask);
 	sigint.sa_flags = SA_RESETHAND;
@@ -188,13 +306,15 @@ wayland_init(unsigned int width, unsigned int height)
 	wl_surface_damage(window->surface, 0, 0,
 		window->width, window->height);
 
-	redraw(window, NULL, 0);
+	/* the first buffer is committed blank */
+	shm_data = wayland_acquire_buffer(ctx, NULL, NULL);
+	if (!shm_data) {
+		fprintf(stderr, "Failed to create the first buffer.\n");
+		wayland_terminate(ctx);
+		return NULL;
+	}
 
-	ctx->display = display;
-	ctx->window = window;
-	ctx->buffer_empty = true;
-
-	display->ctx = ctx;
+	wayland_present_buffer(ctx, shm_data, 0);
 
 	return ctx;
 }
@@ -205,10 +325,19 @@ wayland_terminate(struct wayland_ctx *ctx)
 	if (!ctx)
 		return;
 
+	wayland_cancel_read(ctx);
+
+	while (ctx->feedbacks) {
+		struct feedback *feedback = ctx->feedbacks;
+
+		ctx->feedbacks = feedback->next;
+		wp_presentation_feedback_destroy(feedback->feedback);
+		free(feedback);
+	}
+
 	destroy_window(ctx->window);
 	destroy_display(ctx->display);
 
-	free(ctx->buffer);
 	free(ctx);
 }
 
@@ -230,36 +359,241 @@ wayland_get_height(struct wayland_ctx *ctx)
 	return ctx->window->height;
 }
 
+uint32_t
+wayland_get_format(struct wayland_ctx *ctx)
+{
+	if (!ctx)
+		return 0;
+
+	return ctx->window->format;
+}
+
 bool
 wayland_is_running()
 {
 	return running;
 }
 
+/* polls readable when wayland_read_events() has events to read */
 int
-wayland_dispatch_event(struct wayland_ctx *ctx)
+wayland_get_fd(struct wayland_ctx *ctx)
 {
 	if (!ctx)
 		return -1;
 
-	return wl_display_dispatch(ctx->display->display);
+	return wl_display_get_fd(ctx->display->display);
 }
 
+/*
+ * Dispatches what is already queued and flushes the requests, to be called
+ * before polling the fd. Must be followed by wayland_read_events() or
+ * wayland_cancel_read().
+ */
 bool
-wayland_queue_buffer(struct wayland_ctx *ctx, void *buff)
+wayland_prepare_read(struct wayland_ctx *ctx)
 {
+	struct wl_display *display;
+
 	if (!ctx)
 		return false;
 
-	if (!ctx->buffer_empty)
+	display = ctx->display->display;
+
+	while (wl_display_prepare_read(display) != 0)
+		if (wl_display_dispatch_pending(display) < 0)
+			return false;
+
+	/* socket full, the rest goes out once the fd polls writable */
+	ctx->flush_blocked = false;
+	if (wl_display_flush(display) < 0) {
+		if (errno != EAGAIN) {
+			fprintf(stderr, "wl_display_flush failed: %m\n");
+			wl_display_cancel_read(display);
+			return false;
+		}
+
+		ctx->flush_blocked = true;
+	}
+
+	ctx->reading = true;
+
+	return true;
+}
+
+bool
+wayland_read_events(struct wayland_ctx *ctx)
+{
+	struct wl_display *display;
+
+	if (!ctx || !ctx->reading)
+		return false;
+
+	display = ctx->display->display;
+	ctx->reading = false;
+
+	if (wl_display_read_events(display) < 0)
 		return false;
 
-	memcpy(ctx->buffer, buff, wayland_get_width(ctx) * wayland_get_height(ctx) * 4);
-	ctx->buffer_empty = false;
+	return wl_display_dispatch_pending(display) >= 0;
+}
+
+/*
+ * The last wayland_prepare_read() left requests in the buffer, the fd
+ * should also be polled writable to have the next one flush them.
+ */
+bool
+wayland_needs_writable(struct wayland_ctx *ctx)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->flush_blocked;
+}
+
+/* the fd did not poll ready, nothing to read this time */
+void
+wayland_cancel_read(struct wayland_ctx *ctx)
+{
+	if (!ctx || !ctx->reading)
+		return;
+
+	wl_display_cancel_read(ctx->display->display);
+	ctx->reading = false;
+}
+
+/*
+ * A free buffer of the current window size, marked busy until it is
+ * presented and the compositor releases it. NULL when all are busy. The
+ * buffer memory may be filled from any thread.
+ */
+void *
+wayland_acquire_buffer(struct wayland_ctx *ctx, unsigned int *width, unsigned int *height)
+{
+	struct buffer *buffer;
+
+	if (!ctx)
+		return NULL;
+
+	buffer = window_next_buffer(ctx->window);
+	if (!buffer)
+		return NULL;
+
+	buffer->busy = 1;
+
+	if (width)
+		*width = buffer->width;
+	if (height)
+		*height = buffer->height;
+
+	return buffer->shm_data;
+}
+
+/*
+ * Committed on the next frame callback. A buffer presented before the
+ * previous one was committed replaces it, the older one is free again.
+ * 'tag' comes back with the presentation feedback.
+ */
+bool
+wayland_present_buffer(struct wayland_ctx *ctx, void *shm_data, uint32_t tag)
+{
+	return wayland_present_damage(ctx, shm_data, tag, NULL, 0);
+}
+
+/*
+ * Same, with the rectangles of the buffer that differ from the one committed
+ * before, in buffer pixels. NULL damages the whole buffer.
+ */
+bool
+wayland_present_damage(struct wayland_ctx *ctx, void *shm_data, uint32_t tag,
+	const struct wayland_rect *rects, unsigned int rects_nr)
+{
+	struct buffer *buffer;
+
+	if (!ctx)
+		return false;
+
+	buffer = window_find_buffer(ctx->window, shm_data);
+	if (!buffer || !buffer->busy) {
+		fprintf(stderr, "%p is no acquired buffer\n", shm_data);
+		return false;
+	}
+
+	if (rects && rects_nr <= WAYLAND_RECT_MAX) {
+		memcpy(buffer->damage, rects, rects_nr * sizeof(*rects));
+		buffer->damage_nr = rects_nr;
+	} else {
+		buffer->damage_nr = -1;
+	}
+
+	/* the replaced buffer's changes were never committed, they are lost from the damage */
+	if (ctx->pending) {
+		window_put_buffer(ctx->window, ctx->pending);
+		buffer->damage_nr = -1;
+	}
+
+	buffer->tag = tag;
+	ctx->pending = buffer;
+
+	/* no frame callback outstanding, nothing would pick it up */
+	if (!ctx->window->callback)
+		redraw(ctx->window, NULL, 0);
+
+	return true;
+}
+
+/*
+ * 'func' is called for every committed buffer once the compositor has shown
+ * or discarded it. Needs wp_presentation on the CLOCK_MONOTONIC clock.
+ */
+bool
+wayland_set_feedback(struct wayland_ctx *ctx, wayland_feedback_func func, void *arg)
+{
+	struct display *display;
+
+	if (!ctx)
+		return false;
+
+	display = ctx->display;
+	if (!display->presentation) {
+		fprintf(stderr, "No wp_presentation, no presentation feedback\n");
+		return false;
+	}
+
+	/* the V4L2 timestamps are on CLOCK_MONOTONIC */
+	if (display->presentation_clock != CLOCK_MONOTONIC) {
+		fprintf(stderr, "Presentation clock %u is not CLOCK_MONOTONIC\n", display->presentation_clock);
+		return false;
+	}
+
+	ctx->feedback_func = func;
+	ctx->feedback_arg = arg;
+
+	return true;
+}
+
+/* 'func' is called for every committed buffer once the compositor released it */
+bool
+wayland_set_release(struct wayland_ctx *ctx, wayland_release_func func, void *arg)
+{
+	if (!ctx)
+		return false;
+
+	ctx->release_func = func;
+	ctx->release_arg = arg;
 
 	return true;
 }
 
+/* a presented buffer waits for the frame callback */
+bool
+wayland_is_presenting(struct wayland_ctx *ctx)
+{
+	if (!ctx)
+		return false;
+
+	return ctx->pending != NULL;
+}
+
 
 /*======================================
 	Inner functions
@@ -276,31 +610,34 @@ create_display(void)
 {
 	struct display *display;
 
-	display = malloc(sizeof *display);
+	display = calloc(1, sizeof *display);
 	if (display == NULL) {
 		fprintf(stderr, "out of memory\n");
-		exit(1);
+		return NULL;
 	}
+
 	display->display = wl_display_connect(NULL);
-	assert(display->display);
+	if (!display->display) {
+		fprintf(stderr, "Cannot connect to a Wayland display: %m\n");
+		free(display);
+		return NULL;
+	}
 
-	display->formats = 0;
+	wl_array_init(&display->formats);
 	display->registry = wl_display_get_registry(display->display);
 	wl_registry_add_listener(display->registry,
 		&registry_listener, display);
 	wl_display_roundtrip(display->display);
-	if (display->shm == NULL) {
-		fprintf(stderr, "No wl_shm global\n");
-		exit(1);
+	if (!display->shm || !display->compositor || !display->shell) {
+		fprintf(stderr, "No %s global\n",
+			!display->shm ? "wl_shm" : !display->compositor ? "wl_compositor" : "wl_shell");
+		destroy_display(display);
+		return NULL;
 	}
 
+	/* collect the format events */
 	wl_display_roundtrip(display->display);
 
-	if (!(display->formats & (1 << WL_SHM_FORMAT_XRGB8888))) {
-		fprintf(stderr, "WL_SHM_FORMAT_XRGB32 not available\n");
-		exit(1);
-	}
-
 	wl_display_get_fd(display->display);
 
 	return display;
@@ -318,6 +655,14 @@ destroy_display(struct display *display)
 	if (display->compositor)
 		wl_compositor_destroy(display->compositor);
 
+	if (display->viewporter)
+		wp_viewporter_destroy(display->viewporter);
+
+	if (display->presentation)
+		wp_presentation_destroy(display->presentation);
+
+	wl_array_release(&display->formats);
+
 	wl_registry_destroy(display->registry);
 	wl_display_flush(display->display);
 	wl_display_disconnect(display->display);
@@ -325,9 +670,10 @@ destroy_display(struct display *display)
 }
 
 static struct window *
-create_window(struct display *display, int width, int height)
+create_window(struct display *display, int width, int height, uint32_t format, unsigned int buffers_nr)
 {
 	struct window *window;
+	unsigned int i;
 
 	window = calloc(1, sizeof *window);
 	if (!window)
@@ -337,12 +683,23 @@ create_window(struct display *display, int width, int height)
 	window->display = display;
 	window->width = width;
 	window->height = height;
+	window->format = format;
+	window->buffers_nr = buffers_nr;
+
+	for (i = buffers_nr; i-- > 0; ) {
+		window->buffers[i].window = window;
+		window_put_buffer(window, &window->buffers[i]);
+	}
+
 	window->surface = wl_compositor_create_surface(display->compositor);
 	window->shell_surface = wl_shell_get_shell_surface(display->shell, window->surface);
 
 	if (window->shell_surface)
 		wl_shell_surface_add_listener(window->shell_surface, &shell_surface_listener, window);
 
+	if (display->viewporter)
+		window->viewport = wp_viewporter_get_viewport(display->viewporter, window->surface);
+
 	wl_shell_surface_set_title(window->shell_surface, "simple-shm");
 
 	wl_shell_surface_set_toplevel(window->shell_surface);
@@ -353,58 +710,155 @@ create_window(struct display *display, int width, int height)
 static void
 destroy_window(struct window *window)
 {
+	unsigned int i;
+
 	if (window->callback)
 		wl_callback_destroy(window->callback);
 
-	if (window->buffers[0].buffer)
-		wl_buffer_destroy(window->buffers[0].buffer);
-	if (window->buffers[1].buffer)
-		wl_buffer_destroy(window->buffers[1].buffer);
+	for (i = 0; i < window->buffers_nr; i++)
+		destroy_shm_buffer(&window->buffers[i]);
+
+	unref_shm_pool(window->pool);
+
+	if (window->viewport)
+		wp_viewport_destroy(window->viewport);
 
 	wl_shell_surface_destroy(window->shell_surface);
 	wl_surface_destroy(window->surface);
 	free(window);
 }
 
-static int
-create_shm_buffer(struct display *display, struct buffer *buffer,
-	int width, int height, uint32_t format)
+/* room for every buffer at the current window size */
+static struct pool *
+create_shm_pool(struct window *window)
 {
-	struct wl_shm_pool *pool;
-	int fd, size, stride;
-	void *data;
+	struct pool *pool;
+	size_t buffer_size;
+	int fd;
 
-	stride = width * 4;
-	size = stride * height;
+	pool = calloc(1, sizeof *pool);
+	if (!pool)
+		return NULL;
 
-	fd = create_anonymous_file(size);
-	if (fd < 0) {
-		fprintf(stderr, "creating a buffer file for %d B failed: %m\n", size);
-		return -1;
+	buffer_size = format_get_frame_size(window->format, window->width, window->height);
+	buffer_size = (buffer_size + BUFFER_ALIGN - 1) & ~(size_t)(BUFFER_ALIGN - 1);
+
+	pool->buffer_size = buffer_size;
+	pool->size = buffer_size * window->buffers_nr;
+	pool->width = window->width;
+	pool->height = window->height;
+	pool->refs = 1;
+
+	/* large frames are converted in one pass each, keep the TLB out of it */
+	if (pool->size >= HUGE_PAGE_SIZE) {
+		pool->size = (pool->size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+
+		/* hugetlbfs needs pages reserved by the admin, else transparent ones */
+		pool->data = map_anonymous_file(pool->size, MFD_HUGETLB, &fd);
+		if (pool->data == MAP_FAILED) {
+			pool->data = map_anonymous_file(pool->size, 0, &fd);
+			if (pool->data != MAP_FAILED)
+				madvise(pool->data, pool->size, MADV_HUGEPAGE);
+		}
+	} else {
+		pool->data = map_anonymous_file(pool->size, 0, &fd);
 	}
 
-	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	if (data == MAP_FAILED) {
-		fprintf(stderr, "mmap failed: %m\n");
-		close(fd);
-		return -1;
+	if (pool->data == MAP_FAILED) {
+		fprintf(stderr, "mapping a pool file for %zu B failed: %m\n", pool->size);
+		free(pool);
+		return NULL;
 	}
 
-	pool = wl_shm_create_pool(display->shm, fd, size);
-	buffer->buffer = wl_shm_pool_create_buffer(pool, 0,
-						width, height,
-						stride, format);
-	wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
-	wl_shm_pool_destroy(pool);
+	pool->pool = wl_shm_create_pool(window->display->shm, fd, pool->size);
 	close(fd);
 
-	buffer->shm_data = data;
+	return pool;
+}
+
+/* the mapping outlives a resize until the last buffer of the old size is gone */
+static void
+unref_shm_pool(struct pool *pool)
+{
+	if (!pool || --pool->refs > 0)
+		return;
+
+	wl_shm_pool_destroy(pool->pool);
+	munmap(pool->data, pool->size);
+	free(pool);
+}
+
+static int
+create_shm_buffer(struct window *window, struct buffer *buffer)
+{
+	struct pool *pool = window->pool;
+	size_t offset;
+	int stride;
+
+	if (!pool || pool->width != window->width || pool->height != window->height) {
+		unref_shm_pool(pool);
+
+		pool = window->pool = create_shm_pool(window);
+		if (!pool)
+			return -1;
+	}
+
+	/* planar formats : the chroma planes follow, with the stride the compositor derives */
+	stride = format_get_stride(window->format, window->width);
+	offset = pool->buffer_size * (buffer - window->buffers);
+
+	buffer->buffer = wl_shm_pool_create_buffer(pool->pool, offset,
+						window->width, window->height,
+						stride, fourcc_to_shm(window->format));
+	wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+
+	buffer->pool = pool;
+	pool->refs++;
+
+	buffer->shm_data = (uint8_t *)pool->data + offset;
+	buffer->width = window->width;
+	buffer->height = window->height;
 
 	return 0;
 }
 
+static void
+destroy_shm_buffer(struct buffer *buffer)
+{
+	if (!buffer->buffer)
+		return;
+
+	wl_buffer_destroy(buffer->buffer);
+	unref_shm_pool(buffer->pool);
+
+	buffer->buffer = NULL;
+	buffer->pool = NULL;
+	buffer->shm_data = NULL;
+}
+
+static void *
+map_anonymous_file(off_t size, unsigned int flags, int *fd)
+{
+	void *data;
+
+	*fd = create_anonymous_file(size, flags);
+	if (*fd < 0)
+		return MAP_FAILED;
+
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if (data == MAP_FAILED)
+		close(*fd);
+
+	return data;
+}
+
+/*
+ * A sealed memfd : the compositor may map it without guarding against the
+ * file shrinking under it. 'flags' are extra MFD_* flags, the file in
+ * XDG_RUNTIME_DIR is the fallback for kernels without memfd.
+ */
 static int
-create_anonymous_file(off_t size)
+create_anonymous_file(off_t size, unsigned int flags)
 {
 	static const char template[] = "/weston-shared-XXXXXX";
 	const char *path;
@@ -412,6 +866,22 @@ create_anonymous_file(off_t size)
 	int fd;
 	int ret;
 
+	fd = memfd_create("wl-camera-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING | flags);
+	if (fd >= 0) {
+		if (ftruncate(fd, size) < 0) {
+			close(fd);
+			return -1;
+		}
+
+		if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+			fprintf(stderr, "sealing the pool file failed: %m\n");
+
+		return fd;
+	}
+
+	if (flags)
+		return -1;
+
 	path = getenv("XDG_RUNTIME_DIR");
 	if (!path) {
 		errno = ENOENT;
@@ -471,8 +941,13 @@ static void
 buffer_release(void *data, struct wl_buffer *buffer)
 {
 	struct buffer *mybuf = data;
+	struct wayland_ctx *ctx = mybuf->window->display->ctx;
+
+	if (ctx->release_func && mybuf->commit)
+		ctx->release_func(ctx->release_arg, mybuf->tag, mybuf->commit, util_get_time());
+	mybuf->commit = 0;
 
-	mybuf->busy = 0;
+	window_put_buffer(mybuf->window, mybuf);
 }
 
 static void
@@ -482,32 +957,71 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 	struct buffer *buffer;
 	struct wayland_ctx *ctx = window->display->ctx;
 
-	if (callback && ctx && ctx->buffer_empty)
-		return;
-
-	buffer = window_next_buffer(window);
-	if (!buffer) {
-		fprintf(stderr,
-			!callback ? "Failed to create the first buffer.\n" :
-			"Both buffers busy at redraw(). Server bug?\n");
-		abort();
+	if (callback) {
+		wl_callback_destroy(callback);
+		window->callback = NULL;
 	}
 
-	if (ctx && !ctx->buffer_empty) {
-		memcpy(buffer->shm_data, ctx->buffer, window->width * window->height * 4);
-		ctx->buffer_empty = true;
-	}
+	/* nothing new, wayland_present_buffer() will commit right away */
+	buffer = ctx->pending;
+	if (!buffer)
+		return;
 
-	wl_surface_attach(window->surface, buffer->buffer, 0, 0);
-	wl_surface_damage(window->surface, 0, 0, window->width, window->height);
+	ctx->pending = NULL;
 
-	if (callback)
-		wl_callback_destroy(callback);
+	wl_surface_attach(window->surface, buffer->buffer, 0, 0);
+	damage_surface(window, buffer);
 
 	window->callback = wl_surface_frame(window->surface);
 	wl_callback_add_listener(window->callback, &frame_listener, window);
+
+	buffer->commit = util_get_time();
+
+	if (ctx->feedback_func) {
+		struct feedback *feedback;
+
+		feedback = calloc(1, sizeof *feedback);
+		if (feedback) {
+			feedback->ctx = ctx;
+			feedback->tag = buffer->tag;
+			feedback->commit = buffer->commit;
+			feedback->feedback = wp_presentation_feedback(window->display->presentation, window->surface);
+			wp_presentation_feedback_add_listener(feedback->feedback, &feedback_listener, feedback);
+
+			feedback->next = ctx->feedbacks;
+			ctx->feedbacks = feedback;
+		}
+	}
+
 	wl_surface_commit(window->surface);
-	buffer->busy = 1;
+}
+
+/*
+ * wl_surface.damage is in surface coordinates, the viewport destination when
+ * scaled, only damage_buffer takes buffer rectangles through a viewport
+ */
+static void
+damage_surface(struct window *window, struct buffer *buffer)
+{
+	bool buffer_damage = window->display->compositor_version >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+	int i;
+
+	if (buffer->damage_nr < 0 || (window->dst_width && !buffer_damage)) {
+		if (window->dst_width)
+			wl_surface_damage(window->surface, 0, 0, window->dst_width, window->dst_height);
+		else
+			wl_surface_damage(window->surface, 0, 0, buffer->width, buffer->height);
+		return;
+	}
+
+	for (i = 0; i < buffer->damage_nr; i++) {
+		struct wayland_rect *rect = &buffer->damage[i];
+
+		if (buffer_damage)
+			wl_surface_damage_buffer(window->surface, rect->x, rect->y, rect->width, rect->height);
+		else
+			wl_surface_damage(window->surface, rect->x, rect->y, rect->width, rect->height);
+	}
 }
 
 static struct buffer *
@@ -516,27 +1030,53 @@ window_next_buffer(struct window *window)
 	struct buffer *buffer;
 	int ret = 0;
 
-	if (!window->buffers[0].busy)
-		buffer = &window->buffers[0];
-	else if (!window->buffers[1].busy)
-		buffer = &window->buffers[1];
-	else
+	/* all held by the compositor or by us, the caller skips this frame */
+	buffer = window->free_list;
+	if (!buffer)
 		return NULL;
 
-	if (!buffer->buffer) {
-		ret = create_shm_buffer(window->display, buffer,
-				window->width, window->height,
-				WL_SHM_FORMAT_XRGB8888);
+	window->free_list = buffer->next_free;
+	buffer->next_free = NULL;
 
-		if (ret < 0)
+	/* the window was resized since this buffer was made */
+	if (buffer->buffer &&
+		(buffer->width != window->width || buffer->height != window->height))
+		destroy_shm_buffer(buffer);
+
+	if (!buffer->buffer) {
+		ret = create_shm_buffer(window, buffer);
+		if (ret < 0) {
+			window_put_buffer(window, buffer);
 			return NULL;
+		}
 
-		memset(buffer->shm_data, 0xff, window->width * window->height * 4);
+		/* white, until the first frame arrives */
+		format_fill_white(window->format, buffer->shm_data, window->width, window->height);
 	}
 
 	return buffer;
 }
 
+static struct buffer *
+window_find_buffer(struct window *window, void *shm_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < window->buffers_nr; i++)
+		if (window->buffers[i].buffer && window->buffers[i].shm_data == shm_data)
+			return &window->buffers[i];
+
+	return NULL;
+}
+
+static void
+window_put_buffer(struct window *window, struct buffer *buffer)
+{
+	buffer->busy = 0;
+	buffer->next_free = window->free_list;
+	window->free_list = buffer;
+}
+
 static void
 registry_handle_global(void *data, struct wl_registry *registry,
 	uint32_t id, const char *interface, uint32_t version)
@@ -544,12 +1084,18 @@ registry_handle_global(void *data, struct wl_registry *registry,
 	struct display *d = data;
 
 	if (strcmp(interface, "wl_compositor") == 0) {
-		d->compositor = wl_registry_bind(registry, id, &wl_compositor_interface, 1);
+		d->compositor_version = version < 4 ? version : 4;
+		d->compositor = wl_registry_bind(registry, id, &wl_compositor_interface, d->compositor_version);
 	} else if (strcmp(interface, "wl_shell") == 0) {
 		d->shell = wl_registry_bind(registry, id, &wl_shell_interface, 1);
 	} else if (strcmp(interface, "wl_shm") == 0) {
 		d->shm = wl_registry_bind(registry, id, &wl_shm_interface, 1);
 		wl_shm_add_listener(d->shm, &shm_listener, d);
+	} else if (strcmp(interface, "wp_viewporter") == 0) {
+		d->viewporter = wl_registry_bind(registry, id, &wp_viewporter_interface, 1);
+	} else if (strcmp(interface, "wp_presentation") == 0) {
+		d->presentation = wl_registry_bind(registry, id, &wp_presentation_interface, 1);
+		wp_presentation_add_listener(d->presentation, &presentation_listener, d);
 	}
 }
 
@@ -570,6 +1116,26 @@ static void
 handle_configure(void *data, struct wl_shell_surface *shell_surface,
 	uint32_t edges, int32_t width, int32_t height)
 {
+	struct window *window = data;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	/* buffers stay at camera size, the compositor scales them while compositing */
+	if (window->viewport) {
+		window->dst_width = width;
+		window->dst_height = height;
+		wp_viewport_set_destination(window->viewport, width, height);
+		return;
+	}
+
+	/* YUV buffers go out as the camera made them, nothing scales them */
+	if (window->format != FORMAT_XRGB8888)
+		return;
+
+	/* buffers of the old size are replaced as they come back free */
+	window->width = width;
+	window->height = height;
 }
 
 static void
@@ -577,11 +1143,102 @@ handle_popup_done(void *data, struct wl_shell_surface *shell_surface)
 {
 }
 
+static void
+presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clk_id)
+{
+	struct display *d = data;
+
+	d->presentation_clock = clk_id;
+}
+
+static void
+feedback_sync_output(void *data, struct wp_presentation_feedback *feedback, struct wl_output *output)
+{
+}
+
+static void
+feedback_presented(void *data, struct wp_presentation_feedback *feedback,
+	uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh,
+	uint32_t seq_hi, uint32_t seq_lo, uint32_t flags)
+{
+	uint64_t sec = ((uint64_t)tv_sec_hi << 32) | tv_sec_lo;
+
+	feedback_done(data, sec * 1000000000ULL + tv_nsec);
+}
+
+static void
+feedback_discarded(void *data, struct wp_presentation_feedback *feedback)
+{
+	feedback_done(data, 0);
+}
+
+static void
+feedback_done(struct feedback *feedback, uint64_t presented)
+{
+	struct wayland_ctx *ctx = feedback->ctx;
+	struct feedback **p;
+
+	for (p = &ctx->feedbacks; *p; p = &(*p)->next) {
+		if (*p == feedback) {
+			*p = feedback->next;
+			break;
+		}
+	}
+
+	if (ctx->feedback_func)
+		ctx->feedback_func(ctx->feedback_arg, feedback->tag, feedback->commit, presented);
+
+	wp_presentation_feedback_destroy(feedback->feedback);
+	free(feedback);
+}
+
 static void
 shm_format(void *data, struct wl_shm *wl_shm, uint32_t format)
 {
 	struct display *d = data;
+	uint32_t *p;
+
+	p = wl_array_add(&d->formats, sizeof(*p));
+	if (p)
+		*p = shm_to_fourcc(format);
+}
+
+static bool
+display_has_format(struct display *display, uint32_t format)
+{
+	uint32_t *p;
+
+	wl_array_for_each(p, &display->formats)
+		if (*p == format)
+			return true;
+
+	return false;
+}
+
+/* wl_shm has its own codes for the two mandatory formats, fourcc otherwise */
+static uint32_t
+shm_to_fourcc(uint32_t format)
+{
+	switch (format) {
+	case WL_SHM_FORMAT_ARGB8888:
+		return FORMAT_ARGB8888;
+	case WL_SHM_FORMAT_XRGB8888:
+		return FORMAT_XRGB8888;
+	default:
+		return format;
+	}
+}
 
-	d->formats |= (1 << format);
+static uint32_t
+fourcc_to_shm(uint32_t format)
+{
+	switch (format) {
+	case FORMAT_ARGB8888:
+		return WL_SHM_FORMAT_ARGB8888;
+	case FORMAT_XRGB8888:
+		return WL_SHM_FORMAT_XRGB8888;
+	default:
+		return format;
+	}
 }
 
@@ -32,6 +32,14 @@
 ======================================*/
 
 #include <stdbool.h>
+#include <stdint.h>
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define WAYLAND_RECT_MAX	32	/* damage rectangles per commit, more damages the whole buffer */
 
 
 /*======================================
@@ -40,6 +48,22 @@
 
 struct wayland_ctx;
 
+/* in buffer pixels */
+struct wayland_rect {
+	int32_t x, y;
+	int32_t width, height;
+};
+
+/*
+ * Called once the compositor has shown a committed buffer, 'tag' is the one
+ * it was presented with. Times are CLOCK_MONOTONIC [ns], 'presented' is 0
+ * when the buffer was never shown.
+ */
+typedef void (*wayland_feedback_func)(void *arg, uint32_t tag, uint64_t commit, uint64_t presented);
+
+/* Called once the compositor released a committed buffer, CLOCK_MONOTONIC [ns] */
+typedef void (*wayland_release_func)(void *arg, uint32_t tag, uint64_t commit, uint64_t released);
+
 
 /*======================================
 	Prototypes
@@ -49,13 +73,25 @@ struct wayland_ctx;
 extern "C" {
 #endif /* __cplusplus */
 
-struct wayland_ctx *wayland_init(unsigned int width, unsigned int height);
+struct wayland_ctx *wayland_init(unsigned int width, unsigned int height, const uint32_t *formats, unsigned int formats_nr,
+	unsigned int buffers_nr);
 void wayland_terminate(struct wayland_ctx *ctx);
 unsigned int wayland_get_width(struct wayland_ctx *ctx);
 unsigned int wayland_get_height(struct wayland_ctx *ctx);
+uint32_t wayland_get_format(struct wayland_ctx *ctx);
 bool wayland_is_running();
-int wayland_dispatch_event(struct wayland_ctx *ctx);
-bool wayland_queue_buffer(struct wayland_ctx *ctx, void *buff);
+int wayland_get_fd(struct wayland_ctx *ctx);
+bool wayland_prepare_read(struct wayland_ctx *ctx);
+bool wayland_read_events(struct wayland_ctx *ctx);
+bool wayland_needs_writable(struct wayland_ctx *ctx);
+void wayland_cancel_read(struct wayland_ctx *ctx);
+void *wayland_acquire_buffer(struct wayland_ctx *ctx, unsigned int *width, unsigned int *height);
+bool wayland_present_buffer(struct wayland_ctx *ctx, void *shm_data, uint32_t tag);
+bool wayland_present_damage(struct wayland_ctx *ctx, void *shm_data, uint32_t tag,
+	const struct wayland_rect *rects, unsigned int rects_nr);
+bool wayland_set_feedback(struct wayland_ctx *ctx, wayland_feedback_func func, void *arg);
+bool wayland_set_release(struct wayland_ctx *ctx, wayland_release_func func, void *arg);
+bool wayland_is_presenting(struct wayland_ctx *ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,332 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2014 faith
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*======================================
+	Header include
+======================================*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "common.h"
+#include "worker.h"
+
+
+/*======================================
+	Constant
+======================================*/
+
+#define WORKER_MAX		64
+#define SPIN_COUNT		4096	/* polls before falling back to futex wait */
+
+
+/*======================================
+	Structure
+======================================*/
+
+struct worker {
+	struct worker_ctx  *ctx;
+	pthread_t			thread;
+	unsigned int		index;
+};
+
+struct worker_ctx {
+	unsigned int		threads;	/* including the calling thread */
+	struct worker	   *workers;	/* threads - 1 entries */
+
+	worker_func			func;
+	void			   *arg;
+
+	atomic_uint			generation;	/* bumped once per job */
+	atomic_uint			pending;	/* workers still busy with the job */
+	atomic_bool			quit;
+
+	/* threads in futex wait on either word, no wake syscall while 0 */
+	atomic_uint			generation_sleepers;
+	atomic_uint			pending_sleepers;
+};
+
+
+/*======================================
+	Prototype
+======================================*/
+
+static void *worker_main(void *data);
+static unsigned int wait_change(atomic_uint *addr, unsigned int old, atomic_uint *sleepers);
+static void wait_zero(atomic_uint *addr, atomic_uint *sleepers);
+static void wake(atomic_uint *addr, int nr, atomic_uint *sleepers);
+
+static long futex_wait(atomic_uint *addr, unsigned int val);
+static long futex_wake(atomic_uint *addr, int nr);
+
+static void cpu_relax(void);
+
+
+/*======================================
+	Public function
+======================================*/
+
+struct worker_ctx *
+worker_init(unsigned int threads)
+{
+	struct worker_ctx *ctx;
+	cpu_set_t allowed;
+	int cpus[CPU_SETSIZE];
+	int cpus_nr = 0;
+	unsigned int i;
+
+	if (threads < 1 || threads > WORKER_MAX) {
+		LOG_ERROR("threads(%u) must be in [1, %d]", threads, WORKER_MAX);
+		return NULL;
+	}
+
+	ctx = (struct worker_ctx *)calloc(1, sizeof(struct worker_ctx));
+	if (!ctx) {
+		LOG_ERROR("Out of Memory");
+		return NULL;
+	}
+
+	ctx->threads = threads;
+	atomic_init(&ctx->generation, 0);
+	atomic_init(&ctx->pending, 0);
+	atomic_init(&ctx->quit, false);
+	atomic_init(&ctx->generation_sleepers, 0);
+	atomic_init(&ctx->pending_sleepers, 0);
+
+	if (threads == 1)
+		return ctx;
+
+	ctx->workers = calloc(threads - 1, sizeof(struct worker));
+	if (!ctx->workers) {
+		LOG_ERROR("Out of Memory");
+		free(ctx);
+		return NULL;
+	}
+
+	/* pin every worker to its own CPU out of the ones we may run on */
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+		for (i = 0; i < CPU_SETSIZE; i++)
+			if (CPU_ISSET(i, &allowed))
+				cpus[cpus_nr++] = i;
+	}
+
+	for (i = 0; i < threads - 1; i++) {
+		struct worker *worker = &ctx->workers[i];
+		pthread_attr_t attr;
+		int ret;
+
+		worker->ctx = ctx;
+		worker->index = i + 1;	/* band 0 belongs to the caller */
+
+		pthread_attr_init(&attr);
+		if (cpus_nr > 1) {
+			cpu_set_t set;
+
+			CPU_ZERO(&set);
+			CPU_SET(cpus[worker->index % cpus_nr], &set);
+			pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+		}
+
+		ret = pthread_create(&worker->thread, &attr, worker_main, worker);
+		pthread_attr_destroy(&attr);
+		if (ret != 0) {
+			LOG_ERROR("pthread_create error %d, %s", ret, strerror(ret));
+			ctx->threads = i + 1;
+			worker_terminate(ctx);
+			return NULL;
+		}
+	}
+
+	return ctx;
+}
+
+void
+worker_terminate(struct worker_ctx *ctx)
+{
+	unsigned int i;
+
+	if (!ctx)
+		return;
+
+	if (ctx->threads > 1) {
+		atomic_store(&ctx->quit, true);
+		atomic_fetch_add(&ctx->generation, 1);
+		wake(&ctx->generation, INT_MAX, &ctx->generation_sleepers);
+
+		for (i = 0; i < ctx->threads - 1; i++)
+			pthread_join(ctx->workers[i].thread, NULL);
+	}
+
+	free(ctx->workers);
+	free(ctx);
+}
+
+unsigned int
+worker_get_threads(struct worker_ctx *ctx)
+{
+	if (!ctx)
+		return 0;
+
+	return ctx->threads;
+}
+
+bool
+worker_run(struct worker_ctx *ctx, worker_func func, void *arg)
+{
+	if (!ctx || !func)
+		return false;
+
+	if (ctx->threads == 1) {
+		func(arg, 0, 1);
+		return true;
+	}
+
+	ctx->func = func;
+	ctx->arg = arg;
+	atomic_store(&ctx->pending, ctx->threads - 1);
+
+	/* publish the job, spinning workers see it without the syscall */
+	atomic_fetch_add(&ctx->generation, 1);
+	wake(&ctx->generation, INT_MAX, &ctx->generation_sleepers);
+
+	func(arg, 0, ctx->threads);
+
+	wait_zero(&ctx->pending, &ctx->pending_sleepers);
+
+	return true;
+}
+
+
+/*======================================
+	Inner function
+======================================*/
+
+static void *
+worker_main(void *data)
+{
+	struct worker *worker = data;
+	struct worker_ctx *ctx = worker->ctx;
+	unsigned int seen = 0;
+
+	while (1) {
+		seen = wait_change(&ctx->generation, seen, &ctx->generation_sleepers);
+
+		if (atomic_load(&ctx->quit))
+			break;
+
+		ctx->func(ctx->arg, worker->index, ctx->threads);
+
+		if (atomic_fetch_sub(&ctx->pending, 1) == 1)
+			wake(&ctx->pending, 1, &ctx->pending_sleepers);
+	}
+
+	return NULL;
+}
+
+static unsigned int
+wait_change(atomic_uint *addr, unsigned int old, atomic_uint *sleepers)
+{
+	unsigned int val;
+	int i;
+
+	for (i = 0; i < SPIN_COUNT; i++) {
+		val = atomic_load(addr);
+		if (val != old)
+			return val;
+
+		cpu_relax();
+	}
+
+	atomic_fetch_add(sleepers, 1);
+	while ((val = atomic_load(addr)) == old)
+		futex_wait(addr, old);
+	atomic_fetch_sub(sleepers, 1);
+
+	return val;
+}
+
+static void
+wait_zero(atomic_uint *addr, atomic_uint *sleepers)
+{
+	unsigned int val;
+	int i;
+
+	for (i = 0; i < SPIN_COUNT; i++) {
+		if (atomic_load(addr) == 0)
+			return;
+
+		cpu_relax();
+	}
+
+	atomic_fetch_add(sleepers, 1);
+	while ((val = atomic_load(addr)) != 0)
+		futex_wait(addr, val);
+	atomic_fetch_sub(sleepers, 1);
+}
+
+/*
+ * After a store to 'addr'. Both sides are sequentially consistent : either
+ * a sleeper is counted here, or it reads the new value before it waits.
+ */
+static void
+wake(atomic_uint *addr, int nr, atomic_uint *sleepers)
+{
+	if (atomic_load(sleepers))
+		futex_wake(addr, nr);
+}
+
+static long
+futex_wait(atomic_uint *addr, unsigned int val)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static long
+futex_wake(atomic_uint *addr, int nr)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+static void
+cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}